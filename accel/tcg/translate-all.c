@@ -101,7 +101,13 @@
 #define assert_memory_lock() tcg_debug_assert(have_mmap_lock())
 #endif
 
+/*
+ * Number of writes to a code page before tracking which of its bytes hold
+ * translated code.  Targets with small pages may ask for it sooner.
+ */
+#ifndef SMC_BITMAP_USE_THRESHOLD
 #define SMC_BITMAP_USE_THRESHOLD 10
+#endif
 
 typedef struct PageDesc {
     /* list of TBs intersecting this ram page */
@@ -1,2 +1,4 @@
 TARGET_ARCH=mcs6500
 TARGET_ALIGNED_ONLY=y
+TARGET_SUPPORTS_MTTCG=y
+TARGET_XML_FILES= gdb-xml/mcs6500-core.xml
@@ -0,0 +1,524 @@
+/*
+ * MCS6500 family disassembler
+ *
+ * Copyright (c) 2020 Alexandre Guyon
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "disas/dis-asm.h"
+
+/* Addressing modes, as in target/mcs6500/translate.c */
+enum {
+    M_IMP, M_ACC, M_IMM, M_ZP, M_ZPX, M_ZPY, M_ABS, M_ABX, M_ABY, M_IND,
+    M_IZX, M_IZY, M_REL, M_IZP, M_IAX, M_ZPR,
+};
+
+static const uint8_t operand_size[] = {
+    [M_IMP] = 0, [M_ACC] = 0,
+    [M_IMM] = 1, [M_ZP] = 1, [M_ZPX] = 1, [M_ZPY] = 1,
+    [M_IZX] = 1, [M_IZY] = 1, [M_REL] = 1,
+    [M_ABS] = 2, [M_ABX] = 2, [M_ABY] = 2, [M_IND] = 2,
+    [M_IZP] = 1, [M_IAX] = 2, [M_ZPR] = 2,
+};
+
+typedef struct MCS6500DisasInsn {
+    const char *name;
+    uint8_t mode;
+} MCS6500DisasInsn;
+
+/*
+ * Same layering as the translator: the documented set, then the undocumented
+ * or the 65C02 opcodes laid over it. The Rockwell bit operations and the WDC
+ * WAI and STP are decoded in print_insn_mcs6500().
+ */
+static const MCS6500DisasInsn mcs6500_nmos[256] = {
+    [0x00] = { "brk", M_IMP },
+    [0x01] = { "ora", M_IZX },
+    [0x05] = { "ora", M_ZP },
+    [0x06] = { "asl", M_ZP },
+    [0x08] = { "php", M_IMP },
+    [0x09] = { "ora", M_IMM },
+    [0x0A] = { "asl", M_ACC },
+    [0x0D] = { "ora", M_ABS },
+    [0x0E] = { "asl", M_ABS },
+    [0x10] = { "bpl", M_REL },
+    [0x11] = { "ora", M_IZY },
+    [0x15] = { "ora", M_ZPX },
+    [0x16] = { "asl", M_ZPX },
+    [0x18] = { "clc", M_IMP },
+    [0x19] = { "ora", M_ABY },
+    [0x1D] = { "ora", M_ABX },
+    [0x1E] = { "asl", M_ABX },
+    [0x20] = { "jsr", M_ABS },
+    [0x21] = { "and", M_IZX },
+    [0x24] = { "bit", M_ZP },
+    [0x25] = { "and", M_ZP },
+    [0x26] = { "rol", M_ZP },
+    [0x28] = { "plp", M_IMP },
+    [0x29] = { "and", M_IMM },
+    [0x2A] = { "rol", M_ACC },
+    [0x2C] = { "bit", M_ABS },
+    [0x2D] = { "and", M_ABS },
+    [0x2E] = { "rol", M_ABS },
+    [0x30] = { "bmi", M_REL },
+    [0x31] = { "and", M_IZY },
+    [0x35] = { "and", M_ZPX },
+    [0x36] = { "rol", M_ZPX },
+    [0x38] = { "sec", M_IMP },
+    [0x39] = { "and", M_ABY },
+    [0x3D] = { "and", M_ABX },
+    [0x3E] = { "rol", M_ABX },
+    [0x40] = { "rti", M_IMP },
+    [0x41] = { "eor", M_IZX },
+    [0x45] = { "eor", M_ZP },
+    [0x46] = { "lsr", M_ZP },
+    [0x48] = { "pha", M_IMP },
+    [0x49] = { "eor", M_IMM },
+    [0x4A] = { "lsr", M_ACC },
+    [0x4C] = { "jmp", M_ABS },
+    [0x4D] = { "eor", M_ABS },
+    [0x4E] = { "lsr", M_ABS },
+    [0x50] = { "bvc", M_REL },
+    [0x51] = { "eor", M_IZY },
+    [0x55] = { "eor", M_ZPX },
+    [0x56] = { "lsr", M_ZPX },
+    [0x58] = { "cli", M_IMP },
+    [0x59] = { "eor", M_ABY },
+    [0x5D] = { "eor", M_ABX },
+    [0x5E] = { "lsr", M_ABX },
+    [0x60] = { "rts", M_IMP },
+    [0x61] = { "adc", M_IZX },
+    [0x65] = { "adc", M_ZP },
+    [0x66] = { "ror", M_ZP },
+    [0x68] = { "pla", M_IMP },
+    [0x69] = { "adc", M_IMM },
+    [0x6A] = { "ror", M_ACC },
+    [0x6C] = { "jmp", M_IND },
+    [0x6D] = { "adc", M_ABS },
+    [0x6E] = { "ror", M_ABS },
+    [0x70] = { "bvs", M_REL },
+    [0x71] = { "adc", M_IZY },
+    [0x75] = { "adc", M_ZPX },
+    [0x76] = { "ror", M_ZPX },
+    [0x78] = { "sei", M_IMP },
+    [0x79] = { "adc", M_ABY },
+    [0x7D] = { "adc", M_ABX },
+    [0x7E] = { "ror", M_ABX },
+    [0x81] = { "sta", M_IZX },
+    [0x84] = { "sty", M_ZP },
+    [0x85] = { "sta", M_ZP },
+    [0x86] = { "stx", M_ZP },
+    [0x88] = { "dey", M_IMP },
+    [0x8A] = { "txa", M_IMP },
+    [0x8C] = { "sty", M_ABS },
+    [0x8D] = { "sta", M_ABS },
+    [0x8E] = { "stx", M_ABS },
+    [0x90] = { "bcc", M_REL },
+    [0x91] = { "sta", M_IZY },
+    [0x94] = { "sty", M_ZPX },
+    [0x95] = { "sta", M_ZPX },
+    [0x96] = { "stx", M_ZPY },
+    [0x98] = { "tya", M_IMP },
+    [0x99] = { "sta", M_ABY },
+    [0x9A] = { "txs", M_IMP },
+    [0x9D] = { "sta", M_ABX },
+    [0xA0] = { "ldy", M_IMM },
+    [0xA1] = { "lda", M_IZX },
+    [0xA2] = { "ldx", M_IMM },
+    [0xA4] = { "ldy", M_ZP },
+    [0xA5] = { "lda", M_ZP },
+    [0xA6] = { "ldx", M_ZP },
+    [0xA8] = { "tay", M_IMP },
+    [0xA9] = { "lda", M_IMM },
+    [0xAA] = { "tax", M_IMP },
+    [0xAC] = { "ldy", M_ABS },
+    [0xAD] = { "lda", M_ABS },
+    [0xAE] = { "ldx", M_ABS },
+    [0xB0] = { "bcs", M_REL },
+    [0xB1] = { "lda", M_IZY },
+    [0xB4] = { "ldy", M_ZPX },
+    [0xB5] = { "lda", M_ZPX },
+    [0xB6] = { "ldx", M_ZPY },
+    [0xB8] = { "clv", M_IMP },
+    [0xB9] = { "lda", M_ABY },
+    [0xBA] = { "tsx", M_IMP },
+    [0xBC] = { "ldy", M_ABX },
+    [0xBD] = { "lda", M_ABX },
+    [0xBE] = { "ldx", M_ABY },
+    [0xC0] = { "cpy", M_IMM },
+    [0xC1] = { "cmp", M_IZX },
+    [0xC4] = { "cpy", M_ZP },
+    [0xC5] = { "cmp", M_ZP },
+    [0xC6] = { "dec", M_ZP },
+    [0xC8] = { "iny", M_IMP },
+    [0xC9] = { "cmp", M_IMM },
+    [0xCA] = { "dex", M_IMP },
+    [0xCC] = { "cpy", M_ABS },
+    [0xCD] = { "cmp", M_ABS },
+    [0xCE] = { "dec", M_ABS },
+    [0xD0] = { "bne", M_REL },
+    [0xD1] = { "cmp", M_IZY },
+    [0xD5] = { "cmp", M_ZPX },
+    [0xD6] = { "dec", M_ZPX },
+    [0xD8] = { "cld", M_IMP },
+    [0xD9] = { "cmp", M_ABY },
+    [0xDD] = { "cmp", M_ABX },
+    [0xDE] = { "dec", M_ABX },
+    [0xE0] = { "cpx", M_IMM },
+    [0xE1] = { "sbc", M_IZX },
+    [0xE4] = { "cpx", M_ZP },
+    [0xE5] = { "sbc", M_ZP },
+    [0xE6] = { "inc", M_ZP },
+    [0xE8] = { "inx", M_IMP },
+    [0xE9] = { "sbc", M_IMM },
+    [0xEA] = { "nop", M_IMP },
+    [0xEC] = { "cpx", M_ABS },
+    [0xED] = { "sbc", M_ABS },
+    [0xEE] = { "inc", M_ABS },
+    [0xF0] = { "beq", M_REL },
+    [0xF1] = { "sbc", M_IZY },
+    [0xF5] = { "sbc", M_ZPX },
+    [0xF6] = { "inc", M_ZPX },
+    [0xF8] = { "sed", M_IMP },
+    [0xF9] = { "sbc", M_ABY },
+    [0xFD] = { "sbc", M_ABX },
+    [0xFE] = { "inc", M_ABX },
+};
+
+static const MCS6500DisasInsn mcs6500_undoc[256] = {
+    [0x03] = { "slo", M_IZX },
+    [0x04] = { "nop", M_ZP },
+    [0x07] = { "slo", M_ZP },
+    [0x0B] = { "anc", M_IMM },
+    [0x0C] = { "nop", M_ABS },
+    [0x0F] = { "slo", M_ABS },
+    [0x13] = { "slo", M_IZY },
+    [0x14] = { "nop", M_ZPX },
+    [0x17] = { "slo", M_ZPX },
+    [0x1A] = { "nop", M_IMP },
+    [0x1B] = { "slo", M_ABY },
+    [0x1C] = { "nop", M_ABX },
+    [0x1F] = { "slo", M_ABX },
+    [0x23] = { "rla", M_IZX },
+    [0x27] = { "rla", M_ZP },
+    [0x2B] = { "anc", M_IMM },
+    [0x2F] = { "rla", M_ABS },
+    [0x33] = { "rla", M_IZY },
+    [0x34] = { "nop", M_ZPX },
+    [0x37] = { "rla", M_ZPX },
+    [0x3A] = { "nop", M_IMP },
+    [0x3B] = { "rla", M_ABY },
+    [0x3C] = { "nop", M_ABX },
+    [0x3F] = { "rla", M_ABX },
+    [0x43] = { "sre", M_IZX },
+    [0x44] = { "nop", M_ZP },
+    [0x47] = { "sre", M_ZP },
+    [0x4B] = { "alr", M_IMM },
+    [0x4F] = { "sre", M_ABS },
+    [0x53] = { "sre", M_IZY },
+    [0x54] = { "nop", M_ZPX },
+    [0x57] = { "sre", M_ZPX },
+    [0x5A] = { "nop", M_IMP },
+    [0x5B] = { "sre", M_ABY },
+    [0x5C] = { "nop", M_ABX },
+    [0x5F] = { "sre", M_ABX },
+    [0x63] = { "rra", M_IZX },
+    [0x64] = { "nop", M_ZP },
+    [0x67] = { "rra", M_ZP },
+    [0x6B] = { "arr", M_IMM },
+    [0x6F] = { "rra", M_ABS },
+    [0x73] = { "rra", M_IZY },
+    [0x74] = { "nop", M_ZPX },
+    [0x77] = { "rra", M_ZPX },
+    [0x7A] = { "nop", M_IMP },
+    [0x7B] = { "rra", M_ABY },
+    [0x7C] = { "nop", M_ABX },
+    [0x7F] = { "rra", M_ABX },
+    [0x80] = { "nop", M_IMM },
+    [0x82] = { "nop", M_IMM },
+    [0x83] = { "sax", M_IZX },
+    [0x87] = { "sax", M_ZP },
+    [0x89] = { "nop", M_IMM },
+    [0x8F] = { "sax", M_ABS },
+    [0x97] = { "sax", M_ZPY },
+    [0xA3] = { "lax", M_IZX },
+    [0xA7] = { "lax", M_ZP },
+    [0xAB] = { "lax", M_IMM },
+    [0xAF] = { "lax", M_ABS },
+    [0xB3] = { "lax", M_IZY },
+    [0xB7] = { "lax", M_ZPY },
+    [0xBF] = { "lax", M_ABY },
+    [0xC2] = { "nop", M_IMM },
+    [0xC3] = { "dcp", M_IZX },
+    [0xC7] = { "dcp", M_ZP },
+    [0xCB] = { "sbx", M_IMM },
+    [0xCF] = { "dcp", M_ABS },
+    [0xD3] = { "dcp", M_IZY },
+    [0xD4] = { "nop", M_ZPX },
+    [0xD7] = { "dcp", M_ZPX },
+    [0xDA] = { "nop", M_IMP },
+    [0xDB] = { "dcp", M_ABY },
+    [0xDC] = { "nop", M_ABX },
+    [0xDF] = { "dcp", M_ABX },
+    [0xE2] = { "nop", M_IMM },
+    [0xE3] = { "isc", M_IZX },
+    [0xE7] = { "isc", M_ZP },
+    [0xEB] = { "sbc", M_IMM },
+    [0xEF] = { "isc", M_ABS },
+    [0xF3] = { "isc", M_IZY },
+    [0xF4] = { "nop", M_ZPX },
+    [0xF7] = { "isc", M_ZPX },
+    [0xFA] = { "nop", M_IMP },
+    [0xFB] = { "isc", M_ABY },
+    [0xFC] = { "nop", M_ABX },
+    [0xFF] = { "isc", M_ABX },
+};
+
+static const MCS6500DisasInsn mcs6500_cmos[256] = {
+    [0x02] = { "nop", M_IMM },
+    [0x03] = { "nop", M_IMP },
+    [0x04] = { "tsb", M_ZP },
+    [0x07] = { "nop", M_IMP },
+    [0x0B] = { "nop", M_IMP },
+    [0x0C] = { "tsb", M_ABS },
+    [0x0F] = { "nop", M_IMP },
+    [0x12] = { "ora", M_IZP },
+    [0x13] = { "nop", M_IMP },
+    [0x14] = { "trb", M_ZP },
+    [0x17] = { "nop", M_IMP },
+    [0x1A] = { "inc", M_ACC },
+    [0x1B] = { "nop", M_IMP },
+    [0x1C] = { "trb", M_ABS },
+    [0x1E] = { "asl", M_ABX },
+    [0x1F] = { "nop", M_IMP },
+    [0x22] = { "nop", M_IMM },
+    [0x23] = { "nop", M_IMP },
+    [0x27] = { "nop", M_IMP },
+    [0x2B] = { "nop", M_IMP },
+    [0x2F] = { "nop", M_IMP },
+    [0x32] = { "and", M_IZP },
+    [0x33] = { "nop", M_IMP },
+    [0x34] = { "bit", M_ZPX },
+    [0x37] = { "nop", M_IMP },
+    [0x3A] = { "dec", M_ACC },
+    [0x3B] = { "nop", M_IMP },
+    [0x3C] = { "bit", M_ABX },
+    [0x3E] = { "rol", M_ABX },
+    [0x3F] = { "nop", M_IMP },
+    [0x42] = { "nop", M_IMM },
+    [0x43] = { "nop", M_IMP },
+    [0x44] = { "nop", M_ZP },
+    [0x47] = { "nop", M_IMP },
+    [0x4B] = { "nop", M_IMP },
+    [0x4F] = { "nop", M_IMP },
+    [0x52] = { "eor", M_IZP },
+    [0x53] = { "nop", M_IMP },
+    [0x54] = { "nop", M_ZPX },
+    [0x57] = { "nop", M_IMP },
+    [0x5A] = { "phy", M_IMP },
+    [0x5B] = { "nop", M_IMP },
+    [0x5C] = { "nop", M_ABS },
+    [0x5E] = { "lsr", M_ABX },
+    [0x5F] = { "nop", M_IMP },
+    [0x62] = { "nop", M_IMM },
+    [0x63] = { "nop", M_IMP },
+    [0x64] = { "stz", M_ZP },
+    [0x67] = { "nop", M_IMP },
+    [0x6B] = { "nop", M_IMP },
+    [0x6C] = { "jmp", M_IND },
+    [0x6F] = { "nop", M_IMP },
+    [0x72] = { "adc", M_IZP },
+    [0x73] = { "nop", M_IMP },
+    [0x74] = { "stz", M_ZPX },
+    [0x77] = { "nop", M_IMP },
+    [0x7A] = { "ply", M_IMP },
+    [0x7B] = { "nop", M_IMP },
+    [0x7C] = { "jmp", M_IAX },
+    [0x7E] = { "ror", M_ABX },
+    [0x7F] = { "nop", M_IMP },
+    [0x80] = { "bra", M_REL },
+    [0x82] = { "nop", M_IMM },
+    [0x83] = { "nop", M_IMP },
+    [0x87] = { "nop", M_IMP },
+    [0x89] = { "bit", M_IMM },
+    [0x8B] = { "nop", M_IMP },
+    [0x8F] = { "nop", M_IMP },
+    [0x92] = { "sta", M_IZP },
+    [0x93] = { "nop", M_IMP },
+    [0x97] = { "nop", M_IMP },
+    [0x9B] = { "nop", M_IMP },
+    [0x9C] = { "stz", M_ABS },
+    [0x9E] = { "stz", M_ABX },
+    [0x9F] = { "nop", M_IMP },
+    [0xA3] = { "nop", M_IMP },
+    [0xA7] = { "nop", M_IMP },
+    [0xAB] = { "nop", M_IMP },
+    [0xAF] = { "nop", M_IMP },
+    [0xB2] = { "lda", M_IZP },
+    [0xB3] = { "nop", M_IMP },
+    [0xB7] = { "nop", M_IMP },
+    [0xBB] = { "nop", M_IMP },
+    [0xBF] = { "nop", M_IMP },
+    [0xC2] = { "nop", M_IMM },
+    [0xC3] = { "nop", M_IMP },
+    [0xC7] = { "nop", M_IMP },
+    [0xCB] = { "nop", M_IMP },
+    [0xCF] = { "nop", M_IMP },
+    [0xD2] = { "cmp", M_IZP },
+    [0xD3] = { "nop", M_IMP },
+    [0xD4] = { "nop", M_ZPX },
+    [0xD7] = { "nop", M_IMP },
+    [0xDA] = { "phx", M_IMP },
+    [0xDB] = { "nop", M_IMP },
+    [0xDC] = { "nop", M_ABS },
+    [0xDF] = { "nop", M_IMP },
+    [0xE2] = { "nop", M_IMM },
+    [0xE3] = { "nop", M_IMP },
+    [0xE7] = { "nop", M_IMP },
+    [0xEB] = { "nop", M_IMP },
+    [0xEF] = { "nop", M_IMP },
+    [0xF2] = { "sbc", M_IZP },
+    [0xF3] = { "nop", M_IMP },
+    [0xF4] = { "nop", M_ZPX },
+    [0xF7] = { "nop", M_IMP },
+    [0xFA] = { "plx", M_IMP },
+    [0xFB] = { "nop", M_IMP },
+    [0xFC] = { "nop", M_ABS },
+    [0xFF] = { "nop", M_IMP },
+};
+/* @buf holds the entries that are built on the fly, with their name */
+static const MCS6500DisasInsn *lookup_insn(uint8_t opcode, unsigned long mach,
+                                           MCS6500DisasInsn *buf, char *name)
+{
+    static const MCS6500DisasInsn wai = { "wai", M_IMP };
+    static const MCS6500DisasInsn stp = { "stp", M_IMP };
+
+    if ((mach & bfd_mach_mcs6500_bit_ops) && (opcode & 0x07) == 0x07) {
+        bool set = opcode & 0x80;
+        bool branch = opcode & 0x08;
+
+        snprintf(name, 5, "%s%d", branch ? (set ? "bbs" : "bbr")
+                                         : (set ? "smb" : "rmb"),
+                 (opcode >> 4) & 7);
+        buf->name = name;
+        buf->mode = branch ? M_ZPR : M_ZP;
+        return buf;
+    }
+    if (mach & bfd_mach_mcs6500_wait_stop) {
+        if (opcode == 0xCB) {
+            return &wai;
+        } else if (opcode == 0xDB) {
+            return &stp;
+        }
+    }
+    if ((mach & bfd_mach_mcs6500_cmos) && mcs6500_cmos[opcode].name) {
+        return &mcs6500_cmos[opcode];
+    }
+    if ((mach & bfd_mach_mcs6500_undoc) && mcs6500_undoc[opcode].name) {
+        return &mcs6500_undoc[opcode];
+    }
+    return &mcs6500_nmos[opcode];
+}
+
+int print_insn_mcs6500(bfd_vma addr, disassemble_info *info)
+{
+    MCS6500DisasInsn bit_insn;
+    char bit_name[5];
+    const MCS6500DisasInsn *insn;
+    uint8_t buf[3];
+    uint16_t operand = 0;
+    int size, status;
+
+    status = info->read_memory_func(addr, buf, 1, info);
+    if (status) {
+        info->memory_error_func(status, addr, info);
+        return -1;
+    }
+
+    insn = lookup_insn(buf[0], info->mach, &bit_insn, bit_name);
+    if (!insn->name) {
+        info->fprintf_func(info->stream, ".byte\t$%02x", buf[0]);
+        return 1;
+    }
+
+    size = operand_size[insn->mode];
+    if (size) {
+        status = info->read_memory_func(addr + 1, buf + 1, size, info);
+        if (status) {
+            info->memory_error_func(status, addr + 1, info);
+            return -1;
+        }
+        operand = size == 2 ? lduw_le_p(buf + 1) : buf[1];
+    }
+
+    info->fprintf_func(info->stream, "%s", insn->name);
+
+    switch (insn->mode) {
+    case M_IMP:
+        break;
+    case M_ACC:
+        info->fprintf_func(info->stream, "\ta");
+        break;
+    case M_IMM:
+        info->fprintf_func(info->stream, "\t#$%02x", operand);
+        break;
+    case M_ZP:
+        info->fprintf_func(info->stream, "\t$%02x", operand);
+        break;
+    case M_ZPX:
+        info->fprintf_func(info->stream, "\t$%02x,x", operand);
+        break;
+    case M_ZPY:
+        info->fprintf_func(info->stream, "\t$%02x,y", operand);
+        break;
+    case M_ABS:
+        info->fprintf_func(info->stream, "\t$%04x", operand);
+        break;
+    case M_ABX:
+        info->fprintf_func(info->stream, "\t$%04x,x", operand);
+        break;
+    case M_ABY:
+        info->fprintf_func(info->stream, "\t$%04x,y", operand);
+        break;
+    case M_IND:
+        info->fprintf_func(info->stream, "\t($%04x)", operand);
+        break;
+    case M_IZX:
+        info->fprintf_func(info->stream, "\t($%02x,x)", operand);
+        break;
+    case M_IZY:
+        info->fprintf_func(info->stream, "\t($%02x),y", operand);
+        break;
+    case M_IZP:
+        info->fprintf_func(info->stream, "\t($%02x)", operand);
+        break;
+    case M_IAX:
+        info->fprintf_func(info->stream, "\t($%04x,x)", operand);
+        break;
+    case M_REL:
+        /* Branches show their target */
+        info->fprintf_func(info->stream, "\t$%04x",
+                           (uint16_t)(addr + 2 + (int8_t)operand));
+        break;
+    case M_ZPR:
+        info->fprintf_func(info->stream, "\t$%02x,$%04x", operand & 0xff,
+                           (uint16_t)(addr + 3 + (int8_t)(operand >> 8)));
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    return 1 + size;
+}
@@ -222,6 +222,22 @@ SRST
     Show virtual to physical memory mappings.
 ERST
 
+#if defined(TARGET_MCS6500)
+    {
+        .name       = "tb-profile",
+        .args_type  = "limit:i?",
+        .params     = "[limit]",
+        .help       = "show the TBs the current CPU executed the most",
+        .cmd        = hmp_info_tb_profile,
+    },
+#endif
+
+SRST
+  ``info tb-profile`` [*limit*]
+    Show the *limit* TBs the current CPU executed the most, 20 by default,
+    with their disassembly (MCS6500 only).
+ERST
+
 #if defined(TARGET_I386) || defined(TARGET_RISCV)
     {
         .name       = "mem",
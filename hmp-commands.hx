@@ -1467,6 +1467,57 @@ SRST
   Inject an MCE on the given CPU (x86 only).
 ERST
 
+#if defined(TARGET_MCS6500)
+
+    {
+        .name       = "itrace-dump",
+        .args_type  = "filename:F",
+        .params     = "filename",
+        .help       = "write the instruction trace of the current CPU to a file",
+        .cmd        = hmp_itrace_dump,
+    },
+
+#endif
+SRST
+``itrace-dump`` *filename*
+  Write the instruction trace of the current CPU to *filename*, oldest
+  instruction first (MCS6500 only).
+ERST
+
+#if defined(TARGET_MCS6500)
+
+    {
+        .name       = "mcs6500-snapshot-save",
+        .args_type  = "name:s",
+        .params     = "name",
+        .help       = "take an in-memory snapshot of the machine",
+        .cmd        = hmp_mcs6500_snapshot_save,
+    },
+
+#endif
+SRST
+``mcs6500-snapshot-save`` *name*
+  Take an in-memory snapshot of the machine called *name*, replacing the
+  one which has that name if any. It is lost when QEMU exits (MCS6500 only).
+ERST
+
+#if defined(TARGET_MCS6500)
+
+    {
+        .name       = "mcs6500-snapshot-load",
+        .args_type  = "name:s",
+        .params     = "name",
+        .help       = "restore an in-memory snapshot of the machine",
+        .cmd        = hmp_mcs6500_snapshot_load,
+    },
+
+#endif
+SRST
+``mcs6500-snapshot-load`` *name*
+  Restore the in-memory snapshot called *name*. A machine shut down at the
+  end of a batch run with -no-shutdown is left paused (MCS6500 only).
+ERST
+
     {
         .name       = "getfd",
         .args_type  = "fdname:s",
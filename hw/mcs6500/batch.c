@@ -0,0 +1,83 @@
+/*
+ * Batch runs of mcs6500 machines
+ *
+ * Copyright (c) 2020 Alexandre Guyon
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "sysemu/runstate.h"
+#include "hw/mcs6500/batch.h"
+
+/*
+ * When the CPU has a max-cycles or trap-pc property, it shuts the machine
+ * down once reached. The final state is then printed as a single line on
+ * stdout, with SHA-256 hashes of the RAM and of the last frame, so that
+ * test harnesses compare runs without dumping memory.
+ */
+
+typedef struct {
+    Notifier shutdown;
+    MCS6500CPU *cpu;
+    MemoryRegion *ram;
+    QemuConsole *con;
+} MCS6500BatchState;
+
+static void mcs6500_batch_report(Notifier *notifier, void *data)
+{
+    MCS6500BatchState *s = container_of(notifier, MCS6500BatchState,
+                                        shutdown);
+    CPUMCS6500State *env = &s->cpu->env;
+    g_autofree char *ram_hash = NULL;
+    g_autofree char *fb_hash = NULL;
+
+    ram_hash = g_compute_checksum_for_data(G_CHECKSUM_SHA256,
+                                           memory_region_get_ram_ptr(s->ram),
+                                           memory_region_size(s->ram));
+    if (s->con) {
+        DisplaySurface *surface = qemu_console_surface(s->con);
+
+        fb_hash = g_compute_checksum_for_data(G_CHECKSUM_SHA256,
+                                              surface_data(surface),
+                                              surface_stride(surface)
+                                              * surface_height(surface));
+    }
+
+    /* Tell instances apart when the machine has several */
+    if (CPU_NEXT(first_cpu)) {
+        printf("CPU=%d ", CPU(s->cpu)->cpu_index);
+    }
+    printf("PC=%04x A=%02x X=%02x Y=%02x SP=%02x SR=%02x CYC=%" PRIu64
+           " RAM=%s FB=%s\n",
+           env->pc, env->acc, env->x, env->y, env->sp, cpu_get_sr(env),
+           env->cycles, ram_hash, fb_hash ? fb_hash : "-");
+    fflush(stdout);
+}
+
+/* @con may be NULL for machines without a display */
+void mcs6500_batch_init(MCS6500CPU *cpu, MemoryRegion *ram, QemuConsole *con)
+{
+    MCS6500BatchState *s;
+
+    if (cpu->env.cycle_limit == 0 && cpu->env.trap_pc < 0) {
+        return;
+    }
+
+    s = g_new0(MCS6500BatchState, 1);
+    s->cpu = cpu;
+    s->ram = ram;
+    s->con = con;
+    s->shutdown.notify = mcs6500_batch_report;
+    qemu_register_shutdown_notifier(&s->shutdown);
+}
@@ -17,7 +17,9 @@
  */
 
 #include "qemu/osdep.h"
+#include "qapi/error.h"
 #include "hw/mcs6500/mcs6500.h"
+#include "hw/mcs6500/snapshot.h"
 
 static void mcs6500_init(Object *obj)
 {
@@ -26,7 +28,29 @@ static void mcs6500_init(Object *obj)
 static void mcs6500_realize(DeviceState *dev, Error **errp)
 {
     SocMCS6500State *soc = SOC_MCS6500(dev);
-    soc->cpu = MCS6500_CPU(cpu_create(TYPE_MCS6500_CPU));
+    Object *cpu = object_new(soc->cpu_type);
+    CPUMCS6500State *env;
+
+    if (soc->memory) {
+        object_property_set_link(cpu, "memory", OBJECT(soc->memory),
+                                 &error_abort);
+    }
+    if (!qdev_realize(DEVICE(cpu), NULL, errp)) {
+        object_unref(cpu);
+        return;
+    }
+    soc->cpu = MCS6500_CPU(cpu);
+    env = &soc->cpu->env;
+
+    /* Registers, lazy flags and pending interrupts */
+    mcs6500_snapshot_add(env, offsetof(CPUMCS6500State, end_reset_fields));
+    mcs6500_snapshot_add(&env->cycles, sizeof(env->cycles));
+    mcs6500_snapshot_add(&env->nmi_level, sizeof(env->nmi_level));
+    /* Rewinding before the end of a batch run runs it again */
+    mcs6500_snapshot_add(&env->batch_done, sizeof(env->batch_done));
+    mcs6500_snapshot_add(&CPU(cpu)->halted, sizeof(CPU(cpu)->halted));
+    mcs6500_snapshot_add(&CPU(cpu)->interrupt_request,
+                         sizeof(CPU(cpu)->interrupt_request));
 }
 
 static void mcs6500_class_init(ObjectClass *oc, void *data)
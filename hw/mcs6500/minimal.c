@@ -23,10 +23,68 @@
 #include "hw/hw.h"
 #include "hw/sysbus.h"
 #include "hw/mcs6500/minimal.h"
+#include "hw/mcs6500/mcs6500.h"
+#include "hw/mcs6500/batch.h"
+#include "hw/mcs6500/snapshot.h"
+#include "hw/loader.h"
+#include "qapi/error.h"
+#include "qemu/error-report.h"
+#include "exec/address-spaces.h"
 #include "target/mcs6500/cpu.h"
 
+/*
+ * 64 KiB of RAM and nothing else, -bios loads a flat image at 0x0000 as
+ * expected by conformance tests such as Klaus Dormann's functional test.
+ *
+ * With -smp N, the machine is N such instances which share nothing but the
+ * image: each CPU has its own address space and RAM, so its TBs are its own
+ * too, and runs on its own thread with MTTCG. Instance 0 lives in the system
+ * address space, as seen from the monitor.
+ */
+static void minimal_init_instance(MachineState *machine, int i)
+{
+    SocMCS6500State *soc;
+    MemoryRegion *root = get_system_memory();
+    MemoryRegion *ram = machine->ram;
+    g_autofree char *name = g_strdup_printf("soc[%d]", i);
+
+    if (i > 0) {
+        g_autofree char *root_name = g_strdup_printf("minimal.memory%d", i);
+        g_autofree char *ram_name = g_strdup_printf("minimal.ram%d", i);
+
+        root = g_new(MemoryRegion, 1);
+        memory_region_init(root, OBJECT(machine), root_name, MINIMAL_RAM_SIZE);
+        ram = g_new(MemoryRegion, 1);
+        memory_region_init_ram(ram, NULL, ram_name,
+                               MINIMAL_RAM_SIZE, &error_fatal);
+    }
+
+    soc = SOC_MCS6500(object_new(TYPE_SOC_MCS6500));
+    soc->memory = root;
+    soc->cpu_type = machine->cpu_type;
+    object_property_add_child(OBJECT(machine), name, OBJECT(soc));
+    object_property_set_bool(OBJECT(soc), "realized", true, &error_fatal);
+    object_unref(OBJECT(soc));
+
+    memory_region_add_subregion(root, 0, ram);
+    mcs6500_cpu_set_zp_ram(soc->cpu, memory_region_get_ram_ptr(ram));
+    mcs6500_snapshot_add_ram(ram);
+
+    if (machine->firmware
+            && rom_add_file_fixed_as(machine->firmware, 0, -1,
+                                     CPU(soc->cpu)->as) < 0) {
+        error_report("Cannot load %s", machine->firmware);
+        exit(1);
+    }
+
+    mcs6500_batch_init(soc->cpu, ram, NULL);
+}
+
 static void minimal_init(MachineState *machine)
 {
+    for (int i = 0; i < machine->smp.cpus; ++i) {
+        minimal_init_instance(machine, i);
+    }
 }
 
 static void machine_minimal_init(MachineClass *mc)
@@ -34,7 +92,10 @@ static void machine_minimal_init(MachineClass *mc)
     mc->desc = "Minimal machine for testing purposes";
     mc->init = minimal_init;
     mc->is_default = true;
-    mc->default_cpu_type = TYPE_MCS6500_CPU;
+    mc->default_cpu_type = MCS6500_CPU_TYPE_NAME("6502");
+    mc->default_ram_size = MINIMAL_RAM_SIZE;
+    mc->default_ram_id = "minimal.ram";
+    mc->max_cpus = MINIMAL_MAX_INSTANCES;
 }
 
 DEFINE_MACHINE("minimal", machine_minimal_init)
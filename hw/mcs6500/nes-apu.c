@@ -0,0 +1,908 @@
+/*
+ * Nintendo Nes 2A03 APU
+ *
+ * Copyright (c) 2020 Alexandre Guyon
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/host-utils.h"
+#include "qapi/error.h"
+#include "exec/address-spaces.h"
+#include "hw/irq.h"
+#include "hw/qdev-properties.h"
+#include "hw/qdev-properties-system.h"
+#include "migration/vmstate.h"
+#include "sysemu/reset.h"
+#include "hw/mcs6500/nes-apu.h"
+#include "hw/mcs6500/snapshot.h"
+
+/*
+ * Like the PPU, the APU is not clocked: it catches up with the virtual
+ * clock when a register is accessed, when the audio backend wants samples
+ * and at each step of the frame sequencer, about 240 times a second.
+ *
+ * Channel parameters only change on those events, so the samples in
+ * between are generated in blocks: every channel renders its levels for
+ * the whole block in its own loop, then the channels are mixed together.
+ * Channels are point sampled at the output rate, without band limiting.
+ */
+
+#define APU_BLOCK 256 /* Samples rendered at once */
+
+#define APU_QUARTER (1 << 0)
+#define APU_HALF (1 << 1)
+#define APU_IRQ (1 << 2)
+
+#define APU_STATUS_DMC (1 << 4)
+#define APU_STATUS_FRAME_IRQ (1 << 6)
+#define APU_STATUS_DMC_IRQ (1 << 7)
+
+/* Linear approximation of the mixer, scaled so that the sum fits in 15 bits */
+#define APU_PULSE_WEIGHT 246
+#define APU_TRIANGLE_WEIGHT 279
+#define APU_NOISE_WEIGHT 162
+#define APU_DMC_WEIGHT 110
+
+typedef struct NesAPUStep {
+    uint16_t cycle;
+    uint8_t events;
+} NesAPUStep;
+
+/* Frame sequencer, in CPU cycles from the start of the sequence */
+static const NesAPUStep nes_apu_seq4[] = {
+    { 7457, APU_QUARTER },
+    { 14913, APU_QUARTER | APU_HALF },
+    { 22371, APU_QUARTER },
+    { 29829, APU_QUARTER | APU_HALF | APU_IRQ },
+};
+
+static const NesAPUStep nes_apu_seq5[] = {
+    { 7457, APU_QUARTER },
+    { 14913, APU_QUARTER | APU_HALF },
+    { 22371, APU_QUARTER },
+    { 29829, 0 },
+    { 37281, APU_QUARTER | APU_HALF },
+};
+
+static const uint8_t nes_apu_length[32] = {
+    10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14,
+    12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30,
+};
+
+static const uint8_t nes_apu_duty[4] = { 0x02, 0x06, 0x1e, 0xf9 };
+
+static const uint16_t nes_apu_noise_period[16] = {
+    4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068,
+};
+
+static const uint16_t nes_apu_dmc_rate[16] = {
+    428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72,
+    54,
+};
+
+/* CPU cycles per sample, in 16.16 fixed point */
+static const uint32_t nes_apu_sample_cycles =
+    ((uint64_t)NES_APU_FREQ << 16) / NES_APU_RATE;
+
+static uint64_t nes_apu_ns_to_cycles(int64_t ns)
+{
+    return muldiv64(ns, NES_APU_FREQ, NANOSECONDS_PER_SECOND);
+}
+
+/* Rounded up, so that the cycle is reached at the returned time */
+static int64_t nes_apu_cycles_to_ns(uint64_t cycles)
+{
+    return muldiv64(cycles, NANOSECONDS_PER_SECOND, NES_APU_FREQ) + 1;
+}
+
+static const NesAPUStep *nes_apu_seq(NesAPUState *s, int *nb_steps)
+{
+    if (s->five_step) {
+        *nb_steps = ARRAY_SIZE(nes_apu_seq5);
+        return nes_apu_seq5;
+    }
+    *nb_steps = ARRAY_SIZE(nes_apu_seq4);
+    return nes_apu_seq4;
+}
+
+static void nes_apu_update_irq(NesAPUState *s)
+{
+    qemu_set_irq(s->irq, s->frame_irq || s->dmc.irq);
+}
+
+static uint8_t nes_apu_envelope_volume(const NesAPUEnvelope *e)
+{
+    return e->constant ? e->volume : e->decay;
+}
+
+static void nes_apu_envelope_clock(NesAPUEnvelope *e)
+{
+    if (e->start) {
+        e->start = false;
+        e->decay = 15;
+        e->divider = e->volume;
+    } else if (e->divider == 0) {
+        e->divider = e->volume;
+        if (e->decay) {
+            e->decay--;
+        } else if (e->loop) {
+            e->decay = 15;
+        }
+    } else {
+        e->divider--;
+    }
+}
+
+/* Pulse 1 negates with one's complement, pulse 2 with two's complement */
+static unsigned int nes_apu_sweep_target(const NesAPUPulse *p, int channel)
+{
+    unsigned int change = p->timer >> p->sweep_shift;
+
+    if (p->sweep_negate) {
+        return p->timer - change - (channel == 0);
+    }
+    return p->timer + change;
+}
+
+static void nes_apu_sweep_clock(NesAPUPulse *p, int channel)
+{
+    unsigned int target = nes_apu_sweep_target(p, channel);
+
+    if (p->sweep_divider == 0 && p->sweep_enabled && p->sweep_shift
+            && p->timer >= 8 && target <= 0x7ff) {
+        p->timer = target;
+    }
+    if (p->sweep_divider == 0 || p->sweep_reload) {
+        p->sweep_divider = p->sweep_period;
+        p->sweep_reload = false;
+    } else {
+        p->sweep_divider--;
+    }
+}
+
+static void nes_apu_quarter_frame(NesAPUState *s)
+{
+    NesAPUTriangle *t = &s->triangle;
+
+    nes_apu_envelope_clock(&s->pulse[0].env);
+    nes_apu_envelope_clock(&s->pulse[1].env);
+    nes_apu_envelope_clock(&s->noise.env);
+
+    if (t->linear_reload) {
+        t->linear = t->linear_period;
+    } else if (t->linear) {
+        t->linear--;
+    }
+    if (!t->control) {
+        t->linear_reload = false;
+    }
+}
+
+static void nes_apu_half_frame(NesAPUState *s)
+{
+    for (int i = 0; i < 2; ++i) {
+        NesAPUPulse *p = &s->pulse[i];
+
+        if (p->length && !p->env.loop) {
+            p->length--;
+        }
+        nes_apu_sweep_clock(p, i);
+    }
+    if (s->triangle.length && !s->triangle.control) {
+        s->triangle.length--;
+    }
+    if (s->noise.length && !s->noise.env.loop) {
+        s->noise.length--;
+    }
+}
+
+static void nes_apu_render_pulse(NesAPUPulse *p, int channel, uint8_t *out,
+                                 unsigned int n)
+{
+    uint32_t period = (uint32_t)(p->timer + 1) * 2 << 16;
+    uint8_t volume = nes_apu_envelope_volume(&p->env);
+    uint8_t duty = nes_apu_duty[p->duty];
+
+    if (p->length == 0 || p->timer < 8
+            || nes_apu_sweep_target(p, channel) > 0x7ff) {
+        memset(out, 0, n);
+        return;
+    }
+
+    p->phase %= period;
+    for (unsigned int i = 0; i < n; ++i) {
+        p->phase += nes_apu_sample_cycles;
+        while (p->phase >= period) {
+            p->phase -= period;
+            p->step = (p->step + 1) & 7;
+        }
+        out[i] = (duty >> p->step) & 1 ? volume : 0;
+    }
+}
+
+static uint8_t nes_apu_triangle_level(uint8_t step)
+{
+    return step < 16 ? 15 - step : step - 16;
+}
+
+static void nes_apu_render_triangle(NesAPUTriangle *t, uint8_t *out,
+                                    unsigned int n)
+{
+    uint32_t period = (uint32_t)(t->timer + 1) << 16;
+
+    /* Halted, keeps its level. Ultrasonic periods are not played either */
+    if (t->length == 0 || t->linear == 0 || t->timer < 2) {
+        memset(out, nes_apu_triangle_level(t->step), n);
+        return;
+    }
+
+    t->phase %= period;
+    for (unsigned int i = 0; i < n; ++i) {
+        t->phase += nes_apu_sample_cycles;
+        while (t->phase >= period) {
+            t->phase -= period;
+            t->step = (t->step + 1) & 31;
+        }
+        out[i] = nes_apu_triangle_level(t->step);
+    }
+}
+
+static void nes_apu_render_noise(NesAPUNoise *ns, uint8_t *out,
+                                 unsigned int n)
+{
+    uint32_t period = (uint32_t)nes_apu_noise_period[ns->period] << 16;
+    uint8_t volume = nes_apu_envelope_volume(&ns->env);
+    int tap = ns->mode ? 6 : 1;
+
+    if (ns->length == 0) {
+        memset(out, 0, n);
+        return;
+    }
+
+    ns->phase %= period;
+    for (unsigned int i = 0; i < n; ++i) {
+        ns->phase += nes_apu_sample_cycles;
+        while (ns->phase >= period) {
+            uint16_t feedback = (ns->lfsr ^ (ns->lfsr >> tap)) & 1;
+
+            ns->phase -= period;
+            ns->lfsr = ns->lfsr >> 1 | feedback << 14;
+        }
+        out[i] = ns->lfsr & 1 ? 0 : volume;
+    }
+}
+
+static void nes_apu_dmc_restart(NesAPUDmc *d)
+{
+    d->addr = d->sample_addr;
+    d->remaining = d->sample_length;
+}
+
+/* The sample is read from the CPU bus, as the DMC does */
+static void nes_apu_dmc_fetch(NesAPUDmc *d)
+{
+    d->buffer = address_space_ldub(&address_space_memory, d->addr,
+                                   MEMTXATTRS_UNSPECIFIED, NULL);
+    d->buffer_full = true;
+    d->addr = d->addr == 0xffff ? 0x8000 : d->addr + 1;
+
+    if (--d->remaining == 0) {
+        if (d->loop) {
+            nes_apu_dmc_restart(d);
+        } else if (d->irq_enabled) {
+            d->irq = true;
+        }
+    }
+}
+
+static void nes_apu_dmc_clock(NesAPUDmc *d)
+{
+    if (!d->silence) {
+        if (d->shift & 1) {
+            if (d->level <= 125) {
+                d->level += 2;
+            }
+        } else if (d->level >= 2) {
+            d->level -= 2;
+        }
+    }
+    d->shift >>= 1;
+
+    if (--d->bits == 0) {
+        d->bits = 8;
+        d->silence = !d->buffer_full;
+        if (d->buffer_full) {
+            d->shift = d->buffer;
+            d->buffer_full = false;
+        }
+    }
+    if (!d->buffer_full && d->remaining) {
+        nes_apu_dmc_fetch(d);
+    }
+}
+
+static void nes_apu_render_dmc(NesAPUDmc *d, uint8_t *out, unsigned int n)
+{
+    uint32_t period = (uint32_t)nes_apu_dmc_rate[d->rate] << 16;
+
+    for (unsigned int i = 0; i < n; ++i) {
+        d->phase += nes_apu_sample_cycles;
+        while (d->phase >= period) {
+            d->phase -= period;
+            nes_apu_dmc_clock(d);
+        }
+        out[i] = d->level;
+    }
+}
+
+/*
+ * Mix @n samples of channel levels into the buffer. The sum is a plain
+ * loop over arrays for the compiler to vectorize, the DC blocker which
+ * centers the output is not.
+ */
+static void nes_apu_mix(NesAPUState *s, const uint8_t *pulse0,
+                        const uint8_t *pulse1, const uint8_t *triangle,
+                        const uint8_t *noise, const uint8_t *dmc,
+                        unsigned int n)
+{
+    int32_t mix[APU_BLOCK];
+
+    for (unsigned int i = 0; i < n; ++i) {
+        mix[i] = (pulse0[i] + pulse1[i]) * APU_PULSE_WEIGHT
+            + triangle[i] * APU_TRIANGLE_WEIGHT
+            + noise[i] * APU_NOISE_WEIGHT
+            + dmc[i] * APU_DMC_WEIGHT;
+    }
+
+    for (unsigned int i = 0; i < n; ++i) {
+        /* y[i] = x[i] - x[i - 1] + 0.995 * y[i - 1] */
+        s->dc_out = mix[i] - s->dc_in + ((s->dc_out * 32604) >> 15);
+        s->dc_in = mix[i];
+        mix[i] = s->dc_out;
+    }
+
+    /* Nobody to play them, or the backend is late: drop them */
+    if (s->voice == NULL) {
+        return;
+    }
+    n = MIN(n, NES_APU_BUFFER_SIZE - s->count);
+    for (unsigned int i = 0; i < n; ++i) {
+        s->samples[(s->head + s->count + i) % NES_APU_BUFFER_SIZE] =
+            MIN(MAX(mix[i], INT16_MIN), INT16_MAX);
+    }
+    s->count += n;
+}
+
+/* Generate the samples for the next @cycles CPU cycles */
+static void nes_apu_render(NesAPUState *s, uint64_t cycles)
+{
+    uint8_t pulse0[APU_BLOCK];
+    uint8_t pulse1[APU_BLOCK];
+    uint8_t triangle[APU_BLOCK];
+    uint8_t noise[APU_BLOCK];
+    uint8_t dmc[APU_BLOCK];
+    uint64_t frac = s->sample_frac + cycles * NES_APU_RATE;
+    uint64_t todo = frac / NES_APU_FREQ;
+
+    s->sample_frac = frac % NES_APU_FREQ;
+
+    while (todo) {
+        unsigned int n = MIN(todo, APU_BLOCK);
+
+        nes_apu_render_pulse(&s->pulse[0], 0, pulse0, n);
+        nes_apu_render_pulse(&s->pulse[1], 1, pulse1, n);
+        nes_apu_render_triangle(&s->triangle, triangle, n);
+        nes_apu_render_noise(&s->noise, noise, n);
+        nes_apu_render_dmc(&s->dmc, dmc, n);
+        nes_apu_mix(s, pulse0, pulse1, triangle, noise, dmc, n);
+        todo -= n;
+    }
+}
+
+static void nes_apu_step(NesAPUState *s)
+{
+    int nb_steps;
+    const NesAPUStep *seq = nes_apu_seq(s, &nb_steps);
+    uint8_t events = seq[s->seq_step].events;
+
+    if (events & APU_QUARTER) {
+        nes_apu_quarter_frame(s);
+    }
+    if (events & APU_HALF) {
+        nes_apu_half_frame(s);
+    }
+    if ((events & APU_IRQ) && !s->irq_inhibit) {
+        s->frame_irq = true;
+    }
+
+    if (++s->seq_step == nb_steps) {
+        s->seq_step = 0;
+        s->seq_start += seq[nb_steps - 1].cycle + 1;
+    }
+}
+
+/* Generate the samples and run the frame sequencer up to the current time */
+static void nes_apu_catch_up(NesAPUState *s)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    uint64_t cycle = nes_apu_ns_to_cycles(now - s->start);
+    int nb_steps;
+
+    while (s->cycle < cycle) {
+        const NesAPUStep *seq = nes_apu_seq(s, &nb_steps);
+        uint64_t next = s->seq_start + seq[s->seq_step].cycle;
+        uint64_t until = MIN(next, cycle);
+
+        nes_apu_render(s, until - s->cycle);
+        s->cycle = until;
+        if (until == next) {
+            nes_apu_step(s);
+        }
+    }
+
+    nes_apu_update_irq(s);
+}
+
+static void nes_apu_schedule(NesAPUState *s)
+{
+    int nb_steps;
+    const NesAPUStep *seq = nes_apu_seq(s, &nb_steps);
+
+    timer_mod(s->timer, s->start
+              + nes_apu_cycles_to_ns(s->seq_start + seq[s->seq_step].cycle));
+}
+
+static void nes_apu_timer(void *opaque)
+{
+    NesAPUState *s = opaque;
+
+    nes_apu_catch_up(s);
+    nes_apu_schedule(s);
+}
+
+static void nes_apu_audio_callback(void *opaque, int free)
+{
+    NesAPUState *s = opaque;
+
+    nes_apu_catch_up(s);
+
+    while (free > 0 && s->count) {
+        size_t n = MIN(s->count, NES_APU_BUFFER_SIZE - s->head);
+
+        n = AUD_write(s->voice, &s->samples[s->head],
+                      MIN(n * sizeof(int16_t), free)) / sizeof(int16_t);
+        if (n == 0) {
+            break;
+        }
+        s->head = (s->head + n) % NES_APU_BUFFER_SIZE;
+        s->count -= n;
+        free -= n * sizeof(int16_t);
+    }
+}
+
+static uint64_t nes_apu_read(void *opaque, hwaddr addr, unsigned size)
+{
+    NesAPUState *s = opaque;
+    uint8_t val = 0;
+
+    /* Everything else is write only */
+    if (addr != 0x15) {
+        return 0;
+    }
+
+    nes_apu_catch_up(s);
+    for (int i = 0; i < 2; ++i) {
+        val |= (s->pulse[i].length != 0) << i;
+    }
+    val |= (s->triangle.length != 0) << 2;
+    val |= (s->noise.length != 0) << 3;
+    val |= s->dmc.remaining ? APU_STATUS_DMC : 0;
+    val |= s->frame_irq ? APU_STATUS_FRAME_IRQ : 0;
+    val |= s->dmc.irq ? APU_STATUS_DMC_IRQ : 0;
+
+    s->frame_irq = false;
+    nes_apu_update_irq(s);
+
+    return val;
+}
+
+static void nes_apu_write_envelope(NesAPUEnvelope *e, uint8_t val)
+{
+    e->loop = val & 0x20;
+    e->constant = val & 0x10;
+    e->volume = val & 0xf;
+}
+
+static void nes_apu_write_pulse(NesAPUState *s, int channel, hwaddr reg,
+                                uint8_t val)
+{
+    NesAPUPulse *p = &s->pulse[channel];
+
+    switch (reg) {
+    case 0:
+        p->duty = val >> 6;
+        nes_apu_write_envelope(&p->env, val);
+        break;
+    case 1:
+        p->sweep_enabled = val & 0x80;
+        p->sweep_period = (val >> 4) & 7;
+        p->sweep_negate = val & 0x08;
+        p->sweep_shift = val & 7;
+        p->sweep_reload = true;
+        break;
+    case 2:
+        p->timer = (p->timer & 0x700) | val;
+        break;
+    case 3:
+        p->timer = (p->timer & 0xff) | (val & 7) << 8;
+        if (s->enabled & (1 << channel)) {
+            p->length = nes_apu_length[val >> 3];
+        }
+        p->step = 0;
+        p->env.start = true;
+        break;
+    }
+}
+
+static void nes_apu_write(void *opaque, hwaddr addr, uint64_t val,
+                          unsigned size)
+{
+    NesAPUState *s = opaque;
+    NesAPUTriangle *t = &s->triangle;
+    NesAPUNoise *ns = &s->noise;
+    NesAPUDmc *d = &s->dmc;
+
+    nes_apu_catch_up(s);
+
+    switch (addr) {
+    case 0x00 ... 0x07:
+        nes_apu_write_pulse(s, addr >> 2, addr & 3, val);
+        break;
+    case 0x08:
+        t->control = val & 0x80;
+        t->linear_period = val & 0x7f;
+        break;
+    case 0x0a:
+        t->timer = (t->timer & 0x700) | val;
+        break;
+    case 0x0b:
+        t->timer = (t->timer & 0xff) | (val & 7) << 8;
+        if (s->enabled & (1 << 2)) {
+            t->length = nes_apu_length[val >> 3];
+        }
+        t->linear_reload = true;
+        break;
+    case 0x0c:
+        nes_apu_write_envelope(&ns->env, val);
+        break;
+    case 0x0e:
+        ns->mode = val & 0x80;
+        ns->period = val & 0xf;
+        break;
+    case 0x0f:
+        if (s->enabled & (1 << 3)) {
+            ns->length = nes_apu_length[val >> 3];
+        }
+        ns->env.start = true;
+        break;
+    case 0x10:
+        d->irq_enabled = val & 0x80;
+        if (!d->irq_enabled) {
+            d->irq = false;
+        }
+        d->loop = val & 0x40;
+        d->rate = val & 0xf;
+        break;
+    case 0x11:
+        d->level = val & 0x7f;
+        break;
+    case 0x12:
+        d->sample_addr = 0xc000 | val << 6;
+        break;
+    case 0x13:
+        d->sample_length = val << 4 | 1;
+        break;
+    case 0x15:
+        s->enabled = val & 0x1f;
+        for (int i = 0; i < 2; ++i) {
+            if (!(val & (1 << i))) {
+                s->pulse[i].length = 0;
+            }
+        }
+        if (!(val & (1 << 2))) {
+            t->length = 0;
+        }
+        if (!(val & (1 << 3))) {
+            ns->length = 0;
+        }
+        if (!(val & APU_STATUS_DMC)) {
+            d->remaining = 0;
+        } else if (d->remaining == 0) {
+            nes_apu_dmc_restart(d);
+        }
+        d->irq = false;
+        break;
+    case 0x17:
+        /* Restarts the sequence, the 5-step one with a quarter/half frame */
+        s->five_step = val & 0x80;
+        s->irq_inhibit = val & 0x40;
+        if (s->irq_inhibit) {
+            s->frame_irq = false;
+        }
+        s->seq_start = s->cycle;
+        s->seq_step = 0;
+        if (s->five_step) {
+            nes_apu_quarter_frame(s);
+            nes_apu_half_frame(s);
+        }
+        nes_apu_schedule(s);
+        break;
+    default:
+        break;
+    }
+
+    nes_apu_update_irq(s);
+}
+
+static const MemoryRegionOps nes_apu_ops = {
+    .read = nes_apu_read,
+    .write = nes_apu_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .valid = {
+        .min_access_size = 1,
+        .max_access_size = 1,
+    },
+};
+
+static void nes_apu_reset(void *opaque)
+{
+    NesAPUState *s = opaque;
+
+    memset(s->pulse, 0, sizeof(s->pulse));
+    memset(&s->triangle, 0, sizeof(s->triangle));
+    memset(&s->noise, 0, sizeof(s->noise));
+    memset(&s->dmc, 0, sizeof(s->dmc));
+    s->noise.lfsr = 1;
+    s->dmc.bits = 8;
+    s->dmc.silence = true;
+    s->enabled = 0;
+    s->frame_irq = false;
+
+    s->start = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    s->cycle = 0;
+    s->seq_start = 0;
+    s->seq_step = 0;
+    s->sample_frac = 0;
+    s->head = 0;
+    s->count = 0;
+    nes_apu_update_irq(s);
+    nes_apu_schedule(s);
+}
+
+/*
+ * The IRQ line is not driven again, the interrupt controller keeps its
+ * level. Samples waiting for the backend are not saved.
+ */
+static int nes_apu_post_load(void *opaque, int version_id)
+{
+    NesAPUState *s = opaque;
+
+    s->head = 0;
+    s->count = 0;
+    nes_apu_schedule(s);
+    return 0;
+}
+
+static void nes_apu_snapshot_restore(void *opaque, int64_t delta)
+{
+    NesAPUState *s = opaque;
+
+    s->start += delta;
+    nes_apu_schedule(s);
+}
+
+static const VMStateDescription vmstate_nes_apu_envelope = {
+    .name = "nes-apu/envelope",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_BOOL(start, NesAPUEnvelope),
+        VMSTATE_BOOL(loop, NesAPUEnvelope),
+        VMSTATE_BOOL(constant, NesAPUEnvelope),
+        VMSTATE_UINT8(volume, NesAPUEnvelope),
+        VMSTATE_UINT8(divider, NesAPUEnvelope),
+        VMSTATE_UINT8(decay, NesAPUEnvelope),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_nes_apu_pulse = {
+    .name = "nes-apu/pulse",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_STRUCT(env, NesAPUPulse, 1, vmstate_nes_apu_envelope,
+                       NesAPUEnvelope),
+        VMSTATE_UINT8(duty, NesAPUPulse),
+        VMSTATE_UINT8(step, NesAPUPulse),
+        VMSTATE_UINT16(timer, NesAPUPulse),
+        VMSTATE_UINT32(phase, NesAPUPulse),
+        VMSTATE_UINT8(length, NesAPUPulse),
+        VMSTATE_BOOL(sweep_enabled, NesAPUPulse),
+        VMSTATE_BOOL(sweep_negate, NesAPUPulse),
+        VMSTATE_BOOL(sweep_reload, NesAPUPulse),
+        VMSTATE_UINT8(sweep_period, NesAPUPulse),
+        VMSTATE_UINT8(sweep_shift, NesAPUPulse),
+        VMSTATE_UINT8(sweep_divider, NesAPUPulse),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_nes_apu_triangle = {
+    .name = "nes-apu/triangle",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_BOOL(control, NesAPUTriangle),
+        VMSTATE_BOOL(linear_reload, NesAPUTriangle),
+        VMSTATE_UINT8(linear_period, NesAPUTriangle),
+        VMSTATE_UINT8(linear, NesAPUTriangle),
+        VMSTATE_UINT8(step, NesAPUTriangle),
+        VMSTATE_UINT16(timer, NesAPUTriangle),
+        VMSTATE_UINT32(phase, NesAPUTriangle),
+        VMSTATE_UINT8(length, NesAPUTriangle),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_nes_apu_noise = {
+    .name = "nes-apu/noise",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_STRUCT(env, NesAPUNoise, 1, vmstate_nes_apu_envelope,
+                       NesAPUEnvelope),
+        VMSTATE_BOOL(mode, NesAPUNoise),
+        VMSTATE_UINT8(period, NesAPUNoise),
+        VMSTATE_UINT16(lfsr, NesAPUNoise),
+        VMSTATE_UINT32(phase, NesAPUNoise),
+        VMSTATE_UINT8(length, NesAPUNoise),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_nes_apu_dmc = {
+    .name = "nes-apu/dmc",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_BOOL(irq_enabled, NesAPUDmc),
+        VMSTATE_BOOL(loop, NesAPUDmc),
+        VMSTATE_BOOL(irq, NesAPUDmc),
+        VMSTATE_UINT8(rate, NesAPUDmc),
+        VMSTATE_UINT8(level, NesAPUDmc),
+        VMSTATE_UINT16(sample_addr, NesAPUDmc),
+        VMSTATE_UINT16(sample_length, NesAPUDmc),
+        VMSTATE_UINT16(addr, NesAPUDmc),
+        VMSTATE_UINT16(remaining, NesAPUDmc),
+        VMSTATE_UINT8(shift, NesAPUDmc),
+        VMSTATE_UINT8(bits, NesAPUDmc),
+        VMSTATE_UINT8(buffer, NesAPUDmc),
+        VMSTATE_BOOL(buffer_full, NesAPUDmc),
+        VMSTATE_BOOL(silence, NesAPUDmc),
+        VMSTATE_UINT32(phase, NesAPUDmc),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_nes_apu = {
+    .name = TYPE_NES_APU,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = nes_apu_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_STRUCT_ARRAY(pulse, NesAPUState, 2, 1, vmstate_nes_apu_pulse,
+                             NesAPUPulse),
+        VMSTATE_STRUCT(triangle, NesAPUState, 1, vmstate_nes_apu_triangle,
+                       NesAPUTriangle),
+        VMSTATE_STRUCT(noise, NesAPUState, 1, vmstate_nes_apu_noise,
+                       NesAPUNoise),
+        VMSTATE_STRUCT(dmc, NesAPUState, 1, vmstate_nes_apu_dmc, NesAPUDmc),
+        VMSTATE_UINT8(enabled, NesAPUState),
+        VMSTATE_BOOL(five_step, NesAPUState),
+        VMSTATE_BOOL(irq_inhibit, NesAPUState),
+        VMSTATE_BOOL(frame_irq, NesAPUState),
+        VMSTATE_INT64(start, NesAPUState),
+        VMSTATE_UINT64(cycle, NesAPUState),
+        VMSTATE_UINT64(seq_start, NesAPUState),
+        VMSTATE_INT32(seq_step, NesAPUState),
+        VMSTATE_UINT64(sample_frac, NesAPUState),
+        VMSTATE_INT32(dc_in, NesAPUState),
+        VMSTATE_INT32(dc_out, NesAPUState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void nes_apu_init(Object *obj)
+{
+    NesAPUState *s = NES_APU(obj);
+
+    qdev_init_gpio_out(DEVICE(s), &s->irq, 1);
+}
+
+static void nes_apu_realize(DeviceState *dev, Error **errp)
+{
+    NesAPUState *s = NES_APU(dev);
+    struct audsettings as = {
+        .freq = NES_APU_RATE,
+        .nchannels = 1,
+        .fmt = AUDIO_FORMAT_S16,
+        .endianness = AUDIO_HOST_ENDIANNESS,
+    };
+
+    memory_region_init_io(&s->regs, OBJECT(s), &nes_apu_ops, s, "APU",
+                          NES_APU_REGS_SIZE);
+
+    /* Without a voice the APU still runs, for its length counters and IRQ */
+    AUD_register_card(TYPE_NES_APU, &s->card);
+    s->voice = AUD_open_out(&s->card, s->voice, TYPE_NES_APU, s,
+                            nes_apu_audio_callback, &as);
+    if (s->voice) {
+        AUD_set_active_out(s->voice, 1);
+    } else {
+        AUD_log(TYPE_NES_APU, "Could not open voice\n");
+    }
+
+    s->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, nes_apu_timer, s);
+
+    /* From the channels to the DC blocker, the samples are left out */
+    mcs6500_snapshot_add(s->pulse,
+                         offsetof(NesAPUState, samples)
+                         - offsetof(NesAPUState, pulse));
+    mcs6500_snapshot_add_restore(nes_apu_snapshot_restore, s);
+
+    qemu_register_reset(nes_apu_reset, s);
+}
+
+static Property nes_apu_properties[] = {
+    DEFINE_AUDIO_PROPERTIES(NesAPUState, card),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void nes_apu_class_init(ObjectClass *oc, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(oc);
+
+    dc->realize = nes_apu_realize;
+    dc->vmsd = &vmstate_nes_apu;
+    dc->desc = "Nes 2A03 APU";
+    dc->user_creatable = false;
+    device_class_set_props(dc, nes_apu_properties);
+}
+
+static const TypeInfo nes_apu_type_info = {
+    .name = TYPE_NES_APU,
+    .parent = TYPE_DEVICE,
+    .instance_size = sizeof(NesAPUState),
+    .instance_init = nes_apu_init,
+    .class_init = nes_apu_class_init,
+};
+
+static void nes_apu_register_types(void)
+{
+    type_register_static(&nes_apu_type_info);
+}
+
+type_init(nes_apu_register_types)
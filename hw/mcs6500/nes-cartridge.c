@@ -1,69 +1,339 @@
 #include "qemu/osdep.h"
+#include "qapi/error.h"
 #include "exec/address-spaces.h"
+#include "hw/irq.h"
+#include "migration/vmstate.h"
+#include "sysemu/reset.h"
+#include "hw/mcs6500/snapshot.h"
 #include "hw/mcs6500/nes-cartridge.h"
 #include "hw/video-games/ines.h"
 
 #include <stdio.h>
 
+/*
+ * PRG and CHR ROM are used in place in the read-only mapping of the image,
+ * which several cartridges may share.
+ *
+ * Bank switching only re-points the slot aliases: the ROM is never copied
+ * and the TBs of a bank, indexed by its RAM address, are found again when
+ * the bank comes back. The memory core flushes the TLB on commit.
+ */
+
+static uint64_t nes_cartridge_prg_read(void *opaque, hwaddr addr,
+                                       unsigned size)
+{
+    NesPrgSlot *slot = opaque;
+
+    /* ROMD: only used by the slow path, the TLB reads the ROM directly */
+    return slot->cart->prg_data[addr];
+}
+
+static void nes_cartridge_prg_write(void *opaque, hwaddr addr, uint64_t val,
+                                    unsigned size)
+{
+    NesPrgSlot *slot = opaque;
+    NesCartridgeState *cart = slot->cart;
+
+    if (cart->mapper->write == NULL) {
+        return;
+    }
+
+    /* Banks are slot aligned, so is the offset within the bank */
+    memory_region_transaction_begin();
+    cart->mapper->write(cart, slot->base + (addr & (NES_PRG_SLOT_SIZE - 1)),
+                        val);
+    memory_region_transaction_commit();
+}
+
+static const MemoryRegionOps nes_cartridge_prg_ops = {
+    .read = nes_cartridge_prg_read,
+    .write = nes_cartridge_prg_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .valid = {
+        .min_access_size = 1,
+        .max_access_size = 1,
+    },
+};
+
+unsigned int nes_cartridge_prg_banks(NesCartridgeState *cart, uint64_t size)
+{
+    return MAX(cart->prg_size / size, 1);
+}
+
+/*
+ * Map @bank of @size bytes at CPU address @addr. Bank numbers wrap around
+ * the ROM size as the unconnected address lines do, a bank larger than the
+ * ROM mirrors it.
+ */
+void nes_cartridge_map_prg(NesCartridgeState *cart, hwaddr addr,
+                           uint64_t size, unsigned int bank)
+{
+    int first = (addr - NES_PRG_BASE) / NES_PRG_SLOT_SIZE;
+
+    for (int i = 0; i < size / NES_PRG_SLOT_SIZE; ++i) {
+        hwaddr offset = ((uint64_t)bank * size + i * NES_PRG_SLOT_SIZE)
+            % cart->prg_size;
+        cart->prg_offsets[first + i] = offset;
+        memory_region_set_alias_offset(&cart->prg_slots[first + i].window,
+                                       offset);
+    }
+}
+
+/* Same as nes_cartridge_map_prg() for PPU address @addr */
+void nes_cartridge_map_chr(NesCartridgeState *cart, hwaddr addr,
+                           uint64_t size, unsigned int bank)
+{
+    int first = addr / NES_CHR_SLOT_SIZE;
+
+    for (int i = 0; i < size / NES_CHR_SLOT_SIZE; ++i) {
+        hwaddr offset = ((uint64_t)bank * size + i * NES_CHR_SLOT_SIZE)
+            % cart->chr_size;
+        cart->chr_offsets[first + i] = offset;
+        memory_region_set_alias_offset(&cart->chr_slots[first + i], offset);
+    }
+}
+
+/*
+ * Host address of the pattern table byte at PPU address @addr, for the PPU
+ * to fetch tiles without going through the slots.
+ */
+uint8_t *nes_cartridge_chr_ptr(NesCartridgeState *cart, hwaddr addr)
+{
+    MemoryRegion *slot = &cart->chr_slots[addr / NES_CHR_SLOT_SIZE];
+
+    return (uint8_t *)memory_region_get_ram_ptr(&cart->chr_data)
+        + slot->alias_offset + (addr & (NES_CHR_SLOT_SIZE - 1));
+}
+
+void nes_cartridge_set_mirroring(NesCartridgeState *cart,
+                                 NesMirroring mirroring)
+{
+    cart->mirroring = mirroring;
+}
+
+/* Called by the PPU for every rendered scanline */
+void nes_cartridge_scanline(NesCartridgeState *cart)
+{
+    if (cart->mapper->scanline) {
+        cart->mapper->scanline(cart);
+    }
+}
+
+static void nes_cartridge_reset(void *opaque)
+{
+    NesCartridgeState *cart = opaque;
+
+    memory_region_transaction_begin();
+    cart->mapper->reset(cart);
+    memory_region_transaction_commit();
+}
+
+/* Map the banks again after their offsets have been restored */
+static void nes_cartridge_remap(NesCartridgeState *cart)
+{
+    memory_region_transaction_begin();
+    for (int i = 0; i < NES_PRG_NB_SLOTS; ++i) {
+        memory_region_set_alias_offset(&cart->prg_slots[i].window,
+                                       cart->prg_offsets[i]);
+    }
+    for (int i = 0; i < NES_CHR_NB_SLOTS; ++i) {
+        memory_region_set_alias_offset(&cart->chr_slots[i],
+                                       cart->chr_offsets[i]);
+    }
+    memory_region_transaction_commit();
+}
+
+static int nes_cartridge_post_load(void *opaque, int version_id)
+{
+    nes_cartridge_remap(opaque);
+    return 0;
+}
+
+static void nes_cartridge_snapshot_restore(void *opaque, int64_t delta)
+{
+    nes_cartridge_remap(opaque);
+}
+
+static const VMStateDescription vmstate_nes_cartridge = {
+    .name = TYPE_NES_CARTRIDGE,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = nes_cartridge_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(prg_offsets, NesCartridgeState,
+                             NES_PRG_NB_SLOTS),
+        VMSTATE_UINT32_ARRAY(chr_offsets, NesCartridgeState,
+                             NES_CHR_NB_SLOTS),
+        VMSTATE_UINT32(mirroring, NesCartridgeState),
+        VMSTATE_END_OF_LIST()
+    },
+    .subsections = (const VMStateDescription * []) {
+        &vmstate_nes_mapper_mmc1,
+        &vmstate_nes_mapper_mmc3,
+        NULL
+    }
+};
+
 static void nes_cartridge_init(Object *obj)
 {
-    printf("Init'd\n");
+    NesCartridgeState *cart = NES_CARTRIDGE(obj);
+
+    qdev_init_gpio_out(DEVICE(cart), &cart->irq, 1);
+}
+
+static void nes_cartridge_init_prg(NesCartridgeState *cart, hwaddr base,
+                                   Error **errp)
+{
+    size_t size;
+    int ret;
+
+    ret = ines_get_section_by_id(cart->ines, INES_SECTION_PRG_ROM,
+                                 (void **)&cart->prg_data, &size);
+    if (ret < 0 || size == 0) {
+        error_setg(errp, "Cannot get PRG ROM");
+        return;
+    }
+    cart->prg_size = size;
+
+    memory_region_init(&cart->rom, OBJECT(cart), "PRG ROM",
+                       NES_PRG_NB_SLOTS * NES_PRG_SLOT_SIZE);
+    for (int i = 0; i < NES_PRG_NB_SLOTS; ++i) {
+        NesPrgSlot *slot = &cart->prg_slots[i];
+        char name[] = "PRG ROM viewN";
+
+        slot->cart = cart;
+        slot->base = base + i * NES_PRG_SLOT_SIZE;
+
+        snprintf(name, sizeof(name), "PRG ROM view%d", i);
+        memory_region_init_rom_device_ptr(&slot->view, OBJECT(cart),
+                                          &nes_cartridge_prg_ops, slot, name,
+                                          cart->prg_size, cart->prg_data);
+        snprintf(name, sizeof(name), "PRG ROM slot%d", i);
+        memory_region_init_alias(&slot->window, OBJECT(cart), name,
+                                 &slot->view, 0, NES_PRG_SLOT_SIZE);
+        memory_region_add_subregion(&cart->rom, i * NES_PRG_SLOT_SIZE,
+                                    &slot->window);
+    }
+    memory_region_add_subregion(get_system_memory(), base, &cart->rom);
+}
+
+static void nes_cartridge_init_chr(NesCartridgeState *cart, Error **errp)
+{
+    ERRP_GUARD();
+    void *chr_rom;
+    size_t size;
+
+    if (ines_get_section_by_id(cart->ines, INES_SECTION_CHR_ROM,
+                               &chr_rom, &size) == 0) {
+        memory_region_init_ram_ptr(&cart->chr_data, OBJECT(cart), "CHR ROM",
+                                   size, chr_rom);
+        memory_region_set_readonly(&cart->chr_data, true);
+    } else {
+        /* No CHR ROM, the board has 8 KiB of CHR RAM */
+        size = NES_CHR_SIZE;
+        cart->chr_writable = true;
+        memory_region_init_ram(&cart->chr_data, OBJECT(cart), "CHR RAM",
+                               size, errp);
+        if (*errp) {
+            return;
+        }
+        mcs6500_snapshot_add_ram(&cart->chr_data);
+    }
+    cart->chr_size = size;
+
+    memory_region_init(&cart->chr, OBJECT(cart), "CHR", NES_CHR_SIZE);
+    for (int i = 0; i < NES_CHR_NB_SLOTS; ++i) {
+        char name[] = "CHR slotN";
+
+        snprintf(name, sizeof(name), "CHR slot%d", i);
+        memory_region_init_alias(&cart->chr_slots[i], OBJECT(cart), name,
+                                 &cart->chr_data, 0, NES_CHR_SLOT_SIZE);
+        memory_region_add_subregion(&cart->chr, i * NES_CHR_SLOT_SIZE,
+                                    &cart->chr_slots[i]);
+    }
 }
 
 static void nes_cartridge_realize(DeviceState *dev, Error **errp)
 {
+    ERRP_GUARD();
     NesCartridgeState *cart = NES_CARTRIDGE(dev);
     int ret;
     int sections_size;
     const struct ines_mapper_section *sections;
 
-    ret = ines_load_file(cart->rom_path);
+    ret = ines_load_file(cart->rom_path, &cart->ines);
     if (ret < 0) {
-        printf("Cannot load %s\n", cart->rom_path);
-        // FIXME (aguyon): hanlde error
+        error_setg_errno(errp, -ret, "Cannot load %s", cart->rom_path);
         return;
     }
 
-    ret = ines_is_supported();
+    ret = ines_get_mapper_id(cart->ines);
     if (ret < 0) {
-        printf("Rom not supported\n");
+        error_setg(errp, "Rom not supported");
         return;
     }
+    cart->mapper = nes_mapper_find(ret);
+    if (cart->mapper == NULL) {
+        error_setg(errp, "Mapper %d not supported", ret);
+        return;
+    }
+
+    switch (ines_get_mirroring(cart->ines)) {
+    case INES_MIRRORING_4SCREEN:
+        cart->mirroring = NES_MIRRORING_4SCREEN;
+        break;
+    case INES_MIRRORING_VERTICAL:
+        cart->mirroring = NES_MIRRORING_VERTICAL;
+        break;
+    default:
+        cart->mirroring = NES_MIRRORING_HORIZONTAL;
+        break;
+    }
 
-    sections_size = ines_get_sections(&sections);
+    sections_size = ines_get_sections(cart->ines, &sections);
     if (sections_size < 0) {
-        printf("Cannot retrieve sections\n");
+        error_setg(errp, "Cannot retrieve sections");
         return;
     }
 
     for (int i = 0 ; i < sections_size ; ++i) {
-        void *section;
-        size_t section_size;
-
         switch (sections[i].section_id) {
             case INES_SECTION_PRG_RAM:
-                memory_region_init_ram_nomigrate(&cart->ram, OBJECT(cart), "PRG RAM",
-                        sections[i].end - sections[i].start, errp);
+                memory_region_init_ram(&cart->ram, OBJECT(cart), "PRG RAM",
+                        sections[i].end - sections[i].start + 1, errp);
+                if (*errp) {
+                    return;
+                }
+                mcs6500_snapshot_add_ram(&cart->ram);
                 memory_region_add_subregion(get_system_memory(),
                         sections[i].start, &cart->ram);
                 break;
             case INES_SECTION_PRG_ROM:
-                ret = ines_get_section_by_id(sections[i].section_id, &section, &section_size);
-                if (ret < 0) {
-                    printf("Cannot get section\n");
+                nes_cartridge_init_prg(cart, sections[i].start, errp);
+                if (*errp) {
                     return;
                 }
-                memory_region_init_ram_ptr(&cart->rom, OBJECT(cart), "PRG ROM", section_size, section);
-                memory_region_set_readonly(&cart->rom, true);
-                memory_region_add_subregion(get_system_memory(), sections[i].start, &cart->rom);
                 break;
             default:
-                printf("Cannot handle %d section\n", sections[i].section_id);
+                error_setg(errp, "Cannot handle %d section",
+                           sections[i].section_id);
                 return;
         }
     }
 
-    printf("Realized\n");
+    nes_cartridge_init_chr(cart, errp);
+    if (*errp) {
+        return;
+    }
+
+    mcs6500_snapshot_add(cart->prg_offsets, sizeof(cart->prg_offsets));
+    mcs6500_snapshot_add(cart->chr_offsets, sizeof(cart->chr_offsets));
+    mcs6500_snapshot_add(&cart->mirroring, sizeof(cart->mirroring));
+    mcs6500_snapshot_add(&cart->mapper_state, sizeof(cart->mapper_state));
+    mcs6500_snapshot_add_restore(nes_cartridge_snapshot_restore, cart);
+
+    qemu_register_reset(nes_cartridge_reset, cart);
+    nes_cartridge_reset(cart);
 }
 
 static void nes_cartridge_class_init(ObjectClass *oc, void *data)
@@ -71,6 +341,7 @@ static void nes_cartridge_class_init(ObjectClass *oc, void *data)
     DeviceClass *dc = DEVICE_CLASS(oc);
 
     dc->realize = nes_cartridge_realize;
+    dc->vmsd = &vmstate_nes_cartridge;
     dc->desc = "Nes cartridge";
     dc->user_creatable = false;
 }
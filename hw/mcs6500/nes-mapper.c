@@ -0,0 +1,323 @@
+/*
+ * Nintendo Nes cartridge mappers
+ *
+ * Copyright (c) 2020 Alexandre Guyon
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "hw/irq.h"
+#include "migration/vmstate.h"
+#include "hw/mcs6500/nes-cartridge.h"
+#include "hw/mcs6500/nes-mapper.h"
+#include "hw/video-games/ines.h"
+
+/*
+ * Mappers only describe which bank goes where, nes_cartridge_map_prg() and
+ * nes_cartridge_map_chr() re-point the aliases. Code translated from a bank
+ * stays valid while the bank is switched out.
+ */
+
+/* NROM: 16 or 32 KiB of PRG ROM, 8 KiB of CHR, no register */
+static void nrom_reset(NesCartridgeState *cart)
+{
+    /* A 16 KiB ROM is mirrored in 0xC000-0xFFFF */
+    nes_cartridge_map_prg(cart, 0x8000, 0x8000, 0);
+    nes_cartridge_map_chr(cart, 0x0000, 0x2000, 0);
+}
+
+/* MMC1: registers are loaded serially, one bit per write */
+static void mmc1_update(NesCartridgeState *cart)
+{
+    NesMapperState *s = &cart->mapper_state;
+    static const NesMirroring mirroring[] = {
+        NES_MIRRORING_SINGLE_LOW,
+        NES_MIRRORING_SINGLE_HIGH,
+        NES_MIRRORING_VERTICAL,
+        NES_MIRRORING_HORIZONTAL,
+    };
+
+    nes_cartridge_set_mirroring(cart, mirroring[s->mmc1.control & 3]);
+
+    switch ((s->mmc1.control >> 2) & 3) {
+    case 0:
+    case 1:
+        nes_cartridge_map_prg(cart, 0x8000, 0x8000, (s->mmc1.prg & 0xe) >> 1);
+        break;
+    case 2:
+        nes_cartridge_map_prg(cart, 0x8000, 0x4000, 0);
+        nes_cartridge_map_prg(cart, 0xc000, 0x4000, s->mmc1.prg & 0xf);
+        break;
+    case 3:
+        nes_cartridge_map_prg(cart, 0x8000, 0x4000, s->mmc1.prg & 0xf);
+        nes_cartridge_map_prg(cart, 0xc000, 0x4000,
+                              nes_cartridge_prg_banks(cart, 0x4000) - 1);
+        break;
+    }
+
+    if (s->mmc1.control & 0x10) {
+        nes_cartridge_map_chr(cart, 0x0000, 0x1000, s->mmc1.chr0);
+        nes_cartridge_map_chr(cart, 0x1000, 0x1000, s->mmc1.chr1);
+    } else {
+        nes_cartridge_map_chr(cart, 0x0000, 0x2000, s->mmc1.chr0 >> 1);
+    }
+}
+
+static void mmc1_reset(NesCartridgeState *cart)
+{
+    NesMapperState *s = &cart->mapper_state;
+
+    memset(&s->mmc1, 0, sizeof(s->mmc1));
+    /* The last bank is fixed at 0xC000 on power-on */
+    s->mmc1.control = 0x0c;
+    mmc1_update(cart);
+}
+
+static void mmc1_write(NesCartridgeState *cart, uint16_t addr, uint8_t val)
+{
+    NesMapperState *s = &cart->mapper_state;
+
+    if (val & 0x80) {
+        s->mmc1.shift = 0;
+        s->mmc1.count = 0;
+        s->mmc1.control |= 0x0c;
+        mmc1_update(cart);
+        return;
+    }
+
+    s->mmc1.shift |= (val & 1) << s->mmc1.count;
+    if (++s->mmc1.count < 5) {
+        return;
+    }
+
+    /* The fifth write selects the register with A13 and A14 */
+    switch ((addr >> 13) & 3) {
+    case 0:
+        s->mmc1.control = s->mmc1.shift;
+        break;
+    case 1:
+        s->mmc1.chr0 = s->mmc1.shift;
+        break;
+    case 2:
+        s->mmc1.chr1 = s->mmc1.shift;
+        break;
+    case 3:
+        s->mmc1.prg = s->mmc1.shift;
+        break;
+    }
+    s->mmc1.shift = 0;
+    s->mmc1.count = 0;
+    mmc1_update(cart);
+}
+
+/* UxROM: 16 KiB switched at 0x8000, the last bank fixed at 0xC000 */
+static void uxrom_reset(NesCartridgeState *cart)
+{
+    nes_cartridge_map_prg(cart, 0x8000, 0x4000, 0);
+    nes_cartridge_map_prg(cart, 0xc000, 0x4000,
+                          nes_cartridge_prg_banks(cart, 0x4000) - 1);
+    nes_cartridge_map_chr(cart, 0x0000, 0x2000, 0);
+}
+
+static void uxrom_write(NesCartridgeState *cart, uint16_t addr, uint8_t val)
+{
+    nes_cartridge_map_prg(cart, 0x8000, 0x4000, val);
+}
+
+/* CNROM: fixed PRG, 8 KiB of CHR switched at once */
+static void cnrom_write(NesCartridgeState *cart, uint16_t addr, uint8_t val)
+{
+    nes_cartridge_map_chr(cart, 0x0000, 0x2000, val);
+}
+
+/* MMC3: 8 KiB PRG and 1/2 KiB CHR banks, scanline IRQ */
+static void mmc3_update(NesCartridgeState *cart)
+{
+    NesMapperState *s = &cart->mapper_state;
+    unsigned int second_last = nes_cartridge_prg_banks(cart, 0x2000) - 2;
+    hwaddr chr_inv = s->mmc3.bank_select & 0x80 ? 0x1000 : 0;
+
+    if (s->mmc3.bank_select & 0x40) {
+        nes_cartridge_map_prg(cart, 0x8000, 0x2000, second_last);
+        nes_cartridge_map_prg(cart, 0xc000, 0x2000, s->mmc3.regs[6]);
+    } else {
+        nes_cartridge_map_prg(cart, 0x8000, 0x2000, s->mmc3.regs[6]);
+        nes_cartridge_map_prg(cart, 0xc000, 0x2000, second_last);
+    }
+    nes_cartridge_map_prg(cart, 0xa000, 0x2000, s->mmc3.regs[7]);
+    nes_cartridge_map_prg(cart, 0xe000, 0x2000, second_last + 1);
+
+    /* R0 and R1 select 2 KiB banks, in 1 KiB units */
+    nes_cartridge_map_chr(cart, chr_inv ^ 0x0000, 0x0800, s->mmc3.regs[0] >> 1);
+    nes_cartridge_map_chr(cart, chr_inv ^ 0x0800, 0x0800, s->mmc3.regs[1] >> 1);
+    for (int i = 0; i < 4; ++i) {
+        nes_cartridge_map_chr(cart, chr_inv ^ (0x1000 + i * 0x0400), 0x0400,
+                              s->mmc3.regs[2 + i]);
+    }
+}
+
+static void mmc3_reset(NesCartridgeState *cart)
+{
+    NesMapperState *s = &cart->mapper_state;
+
+    memset(&s->mmc3, 0, sizeof(s->mmc3));
+    qemu_irq_lower(cart->irq);
+    mmc3_update(cart);
+}
+
+static void mmc3_write(NesCartridgeState *cart, uint16_t addr, uint8_t val)
+{
+    NesMapperState *s = &cart->mapper_state;
+
+    switch (addr & 0xe001) {
+    case 0x8000:
+        s->mmc3.bank_select = val;
+        mmc3_update(cart);
+        break;
+    case 0x8001:
+        s->mmc3.regs[s->mmc3.bank_select & 7] = val;
+        mmc3_update(cart);
+        break;
+    case 0xa000:
+        if (cart->mirroring != NES_MIRRORING_4SCREEN) {
+            nes_cartridge_set_mirroring(cart, val & 1 ?
+                                        NES_MIRRORING_HORIZONTAL :
+                                        NES_MIRRORING_VERTICAL);
+        }
+        break;
+    case 0xa001:
+        /* PRG RAM protection is not emulated */
+        break;
+    case 0xc000:
+        s->mmc3.irq_latch = val;
+        break;
+    case 0xc001:
+        s->mmc3.irq_counter = 0;
+        s->mmc3.irq_reload = true;
+        break;
+    case 0xe000:
+        s->mmc3.irq_enabled = false;
+        qemu_irq_lower(cart->irq);
+        break;
+    case 0xe001:
+        s->mmc3.irq_enabled = true;
+        break;
+    }
+}
+
+static void mmc3_scanline(NesCartridgeState *cart)
+{
+    NesMapperState *s = &cart->mapper_state;
+
+    if (s->mmc3.irq_counter == 0 || s->mmc3.irq_reload) {
+        s->mmc3.irq_counter = s->mmc3.irq_latch;
+        s->mmc3.irq_reload = false;
+    } else {
+        s->mmc3.irq_counter--;
+    }
+
+    if (s->mmc3.irq_counter == 0 && s->mmc3.irq_enabled) {
+        qemu_irq_raise(cart->irq);
+    }
+}
+
+static bool mmc1_needed(void *opaque)
+{
+    NesCartridgeState *cart = opaque;
+
+    return cart->mapper->id == INES_MAPPER_MMC1;
+}
+
+const VMStateDescription vmstate_nes_mapper_mmc1 = {
+    .name = "nescartridge/mmc1",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = mmc1_needed,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT8(mapper_state.mmc1.shift, NesCartridgeState),
+        VMSTATE_UINT8(mapper_state.mmc1.count, NesCartridgeState),
+        VMSTATE_UINT8(mapper_state.mmc1.control, NesCartridgeState),
+        VMSTATE_UINT8(mapper_state.mmc1.chr0, NesCartridgeState),
+        VMSTATE_UINT8(mapper_state.mmc1.chr1, NesCartridgeState),
+        VMSTATE_UINT8(mapper_state.mmc1.prg, NesCartridgeState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static bool mmc3_needed(void *opaque)
+{
+    NesCartridgeState *cart = opaque;
+
+    return cart->mapper->id == INES_MAPPER_MMC3;
+}
+
+const VMStateDescription vmstate_nes_mapper_mmc3 = {
+    .name = "nescartridge/mmc3",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = mmc3_needed,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT8(mapper_state.mmc3.bank_select, NesCartridgeState),
+        VMSTATE_UINT8_ARRAY(mapper_state.mmc3.regs, NesCartridgeState, 8),
+        VMSTATE_UINT8(mapper_state.mmc3.irq_latch, NesCartridgeState),
+        VMSTATE_UINT8(mapper_state.mmc3.irq_counter, NesCartridgeState),
+        VMSTATE_BOOL(mapper_state.mmc3.irq_reload, NesCartridgeState),
+        VMSTATE_BOOL(mapper_state.mmc3.irq_enabled, NesCartridgeState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const NesMapper nes_mappers[] = {
+    {
+        .id = INES_MAPPER_NROM,
+        .name = "NROM",
+        .reset = nrom_reset,
+    },
+    {
+        .id = INES_MAPPER_MMC1,
+        .name = "MMC1",
+        .reset = mmc1_reset,
+        .write = mmc1_write,
+    },
+    {
+        .id = INES_MAPPER_UXROM,
+        .name = "UxROM",
+        .reset = uxrom_reset,
+        .write = uxrom_write,
+    },
+    {
+        .id = INES_MAPPER_CNROM,
+        .name = "CNROM",
+        .reset = nrom_reset,
+        .write = cnrom_write,
+    },
+    {
+        .id = INES_MAPPER_MMC3,
+        .name = "MMC3",
+        .reset = mmc3_reset,
+        .write = mmc3_write,
+        .scanline = mmc3_scanline,
+    },
+};
+
+const NesMapper *nes_mapper_find(uint8_t id)
+{
+    for (int i = 0; i < ARRAY_SIZE(nes_mappers); ++i) {
+        if (nes_mappers[i].id == id) {
+            return &nes_mappers[i];
+        }
+    }
+
+    return NULL;
+}
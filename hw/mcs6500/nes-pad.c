@@ -0,0 +1,225 @@
+/*
+ * Nintendo Nes standard controllers
+ *
+ * Copyright (c) 2020 Alexandre Guyon
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "hw/qdev-properties.h"
+#include "migration/vmstate.h"
+#include "sysemu/reset.h"
+#include "hw/mcs6500/nes-pad.h"
+#include "hw/mcs6500/snapshot.h"
+
+/* Upper bits of the reads, left on the data bus by the address high byte */
+#define PAD_OPEN_BUS 0x40
+
+/* Buttons of controller @pad for this frame */
+static uint8_t nes_pad_buttons(NesPadState *s, int pad)
+{
+    if (s->movie) {
+        uint64_t frame = s->ppu->frame_count - s->movie_start;
+
+        if (frame < s->movie_frames) {
+            return s->movie_data[frame * NES_NB_PADS + pad];
+        }
+    }
+
+    /* Live input, once the movie is over */
+    return pad == 0 ? s->buttons : 0;
+}
+
+static void nes_pad_latch(NesPadState *s)
+{
+    for (int i = 0; i < NES_NB_PADS; ++i) {
+        s->shift[i] = nes_pad_buttons(s, i);
+    }
+}
+
+static uint64_t nes_pad_read(void *opaque, hwaddr addr, unsigned size)
+{
+    NesPadState *s = opaque;
+    uint8_t val;
+
+    if (s->strobe) {
+        nes_pad_latch(s);
+    }
+    val = s->shift[addr] & 1;
+    /* Official controllers return 1 after the 8 buttons */
+    s->shift[addr] = s->shift[addr] >> 1 | 0x80;
+
+    return PAD_OPEN_BUS | val;
+}
+
+static void nes_pad_write(void *opaque, hwaddr addr, uint64_t val,
+                          unsigned size)
+{
+    NesPadState *s = opaque;
+
+    if (addr == 1) {
+        memory_region_dispatch_write(s->apu, 0x17, val, MO_8,
+                                     MEMTXATTRS_UNSPECIFIED);
+        return;
+    }
+
+    /* The buttons are latched while the strobe is high */
+    s->strobe = val & 1;
+    if (s->strobe) {
+        nes_pad_latch(s);
+    }
+}
+
+static const MemoryRegionOps nes_pad_ops = {
+    .read = nes_pad_read,
+    .write = nes_pad_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .valid = {
+        .min_access_size = 1,
+        .max_access_size = 1,
+    },
+};
+
+static uint8_t nes_pad_button_of(int qcode)
+{
+    switch (qcode) {
+    case Q_KEY_CODE_X:
+        return NES_PAD_A;
+    case Q_KEY_CODE_Z:
+        return NES_PAD_B;
+    case Q_KEY_CODE_SHIFT_R:
+        return NES_PAD_SELECT;
+    case Q_KEY_CODE_RET:
+        return NES_PAD_START;
+    case Q_KEY_CODE_UP:
+        return NES_PAD_UP;
+    case Q_KEY_CODE_DOWN:
+        return NES_PAD_DOWN;
+    case Q_KEY_CODE_LEFT:
+        return NES_PAD_LEFT;
+    case Q_KEY_CODE_RIGHT:
+        return NES_PAD_RIGHT;
+    default:
+        return 0;
+    }
+}
+
+static void nes_pad_input_event(DeviceState *dev, QemuConsole *src,
+                                InputEvent *evt)
+{
+    NesPadState *s = NES_PAD(dev);
+    InputKeyEvent *key = evt->u.key.data;
+    uint8_t button = nes_pad_button_of(qemu_input_key_value_to_qcode(key->key));
+
+    if (key->down) {
+        s->buttons |= button;
+    } else {
+        s->buttons &= ~button;
+    }
+}
+
+static QemuInputHandler nes_pad_input_handler = {
+    .name = "Nes controller",
+    .mask = INPUT_EVENT_MASK_KEY,
+    .event = nes_pad_input_event,
+};
+
+static void nes_pad_reset(void *opaque)
+{
+    NesPadState *s = opaque;
+
+    memset(s->shift, 0, sizeof(s->shift));
+    s->strobe = false;
+    /* Movies start with the first frame after a reset */
+    s->movie_start = s->ppu->frame_count;
+}
+
+static const VMStateDescription vmstate_nes_pad = {
+    .name = TYPE_NES_PAD,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT8_ARRAY(shift, NesPadState, NES_NB_PADS),
+        VMSTATE_BOOL(strobe, NesPadState),
+        VMSTATE_UINT64(movie_start, NesPadState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void nes_pad_realize(DeviceState *dev, Error **errp)
+{
+    NesPadState *s = NES_PAD(dev);
+
+    if (s->apu == NULL || s->ppu == NULL) {
+        error_setg(errp, "Controllers have no APU or PPU");
+        return;
+    }
+
+    if (s->movie_path) {
+        GError *gerr = NULL;
+
+        s->movie = g_mapped_file_new(s->movie_path, false, &gerr);
+        if (!s->movie) {
+            error_setg(errp, "Can't map movie '%s': %s", s->movie_path,
+                       gerr->message);
+            g_error_free(gerr);
+            return;
+        }
+        s->movie_data = (const uint8_t *)g_mapped_file_get_contents(s->movie);
+        s->movie_frames = g_mapped_file_get_length(s->movie) / NES_NB_PADS;
+    }
+
+    memory_region_init_io(&s->regs, OBJECT(s), &nes_pad_ops, s, "controllers",
+                          NES_PAD_REGS_SIZE);
+
+    s->input = qemu_input_handler_register(dev, &nes_pad_input_handler);
+    qemu_input_handler_activate(s->input);
+
+    /* The shift registers on, the held keys are the host's */
+    mcs6500_snapshot_add(s->shift,
+                         sizeof(*s) - offsetof(NesPadState, shift));
+
+    qemu_register_reset(nes_pad_reset, s);
+}
+
+static Property nes_pad_properties[] = {
+    DEFINE_PROP_STRING("movie", NesPadState, movie_path),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void nes_pad_class_init(ObjectClass *oc, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(oc);
+
+    dc->realize = nes_pad_realize;
+    dc->vmsd = &vmstate_nes_pad;
+    dc->desc = "Nes standard controllers";
+    dc->user_creatable = false;
+    device_class_set_props(dc, nes_pad_properties);
+}
+
+static const TypeInfo nes_pad_type_info = {
+    .name = TYPE_NES_PAD,
+    .parent = TYPE_DEVICE,
+    .instance_size = sizeof(NesPadState),
+    .class_init = nes_pad_class_init,
+};
+
+static void nes_pad_register_types(void)
+{
+    type_register_static(&nes_pad_type_info);
+}
+
+type_init(nes_pad_register_types)
@@ -0,0 +1,735 @@
+/*
+ * Nintendo Nes 2C02 PPU
+ *
+ * Copyright (c) 2020 Alexandre Guyon
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/host-utils.h"
+#include "qapi/error.h"
+#include "exec/address-spaces.h"
+#include "hw/irq.h"
+#include "migration/vmstate.h"
+#include "sysemu/reset.h"
+#include "hw/mcs6500/nes-ppu.h"
+#include "hw/mcs6500/snapshot.h"
+
+/*
+ * The PPU is not clocked: it catches up with the virtual clock when a
+ * register is accessed, when its timer fires or when the display wants a
+ * frame. Whole scanlines are rendered at once, with the registers as they
+ * are at the start of the line. Unless the mapper counts scanlines, the
+ * only timer events of a frame are the start and the end of the vertical
+ * blank, and those of the few lines sprite 0 covers while the guest polls
+ * its hit. The visible lines are then usually rendered in a single batch.
+ */
+
+#define PPU_CTRL_INC32 (1 << 2)
+#define PPU_CTRL_SPR_PT (1 << 3)
+#define PPU_CTRL_BG_PT (1 << 4)
+#define PPU_CTRL_SPR_16 (1 << 5)
+#define PPU_CTRL_NMI (1 << 7)
+
+#define PPU_MASK_GRAY (1 << 0)
+#define PPU_MASK_BG_LEFT (1 << 1)
+#define PPU_MASK_SPR_LEFT (1 << 2)
+#define PPU_MASK_BG (1 << 3)
+#define PPU_MASK_SPR (1 << 4)
+
+#define PPU_STATUS_OVERFLOW (1 << 5)
+#define PPU_STATUS_SPRITE0 (1 << 6)
+#define PPU_STATUS_VBLANK (1 << 7)
+
+/* Bits of v and t, see nes_ppu_process_line() */
+#define PPU_V_HORIZONTAL 0x041f
+
+#define PPU_REGS_SIZE 0x2000 /* 8 registers mirrored up to 0x3FFF */
+
+/* 2C02 palette, as 0xRRGGBB */
+static const uint32_t nes_ppu_rgb[64] = {
+    0x666666, 0x002a88, 0x1412a7, 0x3b00a4, 0x5c007e, 0x6e0040, 0x6c0600,
+    0x561d00, 0x333500, 0x0b4800, 0x005200, 0x004f08, 0x00404d, 0x000000,
+    0x000000, 0x000000,
+    0xadadad, 0x155fd9, 0x4240ff, 0x7527fe, 0xa01acc, 0xb71e7b, 0xb53120,
+    0x994e00, 0x6b6d00, 0x388700, 0x0c9300, 0x008f32, 0x007c8d, 0x000000,
+    0x000000, 0x000000,
+    0xfffeff, 0x64b0ff, 0x9290ff, 0xc676ff, 0xf36aff, 0xfe6ecc, 0xfe8170,
+    0xea9e22, 0xbcbe00, 0x88d800, 0x5ce430, 0x45e082, 0x48cdde, 0x4f4f4f,
+    0x000000, 0x000000,
+    0xfffeff, 0xc0dfff, 0xd3d2ff, 0xe8c8ff, 0xfbc2ff, 0xfec4ea, 0xfeccc5,
+    0xf7d8a5, 0xe4e594, 0xcfef96, 0xbdf4ab, 0xb3f3cc, 0xb5ebf2, 0xb8b8b8,
+    0x000000, 0x000000,
+};
+
+static int64_t nes_ppu_dots_to_ns(int64_t dots)
+{
+    return muldiv64(dots, NANOSECONDS_PER_SECOND, NES_PPU_FREQ);
+}
+
+static int64_t nes_ppu_ns_to_dots(int64_t ns)
+{
+    return muldiv64(ns, NES_PPU_FREQ, NANOSECONDS_PER_SECOND);
+}
+
+static bool nes_ppu_rendering(NesPPUState *s)
+{
+    return s->mask & (PPU_MASK_BG | PPU_MASK_SPR);
+}
+
+/*
+ * Whether sprite 0 can still hit in this frame, as it needs both layers and
+ * only covers lines @first to @last excluded.
+ */
+static bool nes_ppu_sprite0_lines(NesPPUState *s, int *first, int *last)
+{
+    int height = s->ctrl & PPU_CTRL_SPR_16 ? 16 : 8;
+
+    if ((s->mask & (PPU_MASK_BG | PPU_MASK_SPR))
+            != (PPU_MASK_BG | PPU_MASK_SPR)) {
+        return false;
+    }
+    /* Sprites are delayed by one line */
+    *first = s->oam[0] + 1;
+    *last = MIN(*first + height, NES_PPU_HEIGHT);
+    /* Games hide sprites below the last line */
+    return *first < *last && s->line < *last;
+}
+
+/* Offset in vram of nametable address @addr, following the cartridge */
+static unsigned int nes_ppu_nt_index(NesPPUState *s, uint16_t addr)
+{
+    unsigned int table = (addr >> 10) & 3;
+
+    switch (s->cart->mirroring) {
+    case NES_MIRRORING_HORIZONTAL:
+        table >>= 1;
+        break;
+    case NES_MIRRORING_VERTICAL:
+        table &= 1;
+        break;
+    case NES_MIRRORING_SINGLE_LOW:
+        table = 0;
+        break;
+    case NES_MIRRORING_SINGLE_HIGH:
+        table = 1;
+        break;
+    case NES_MIRRORING_4SCREEN:
+        break;
+    }
+
+    return table << 10 | (addr & 0x3ff);
+}
+
+/* The backdrop entries of the sprite palettes mirror the background ones */
+static unsigned int nes_ppu_palette_index(uint16_t addr)
+{
+    addr &= 0x1f;
+    if ((addr & 0x13) == 0x10) {
+        addr &= ~0x10;
+    }
+    return addr;
+}
+
+static uint8_t nes_ppu_vram_read(NesPPUState *s, uint16_t addr)
+{
+    addr &= 0x3fff;
+    if (addr < NES_CHR_SIZE) {
+        return *nes_cartridge_chr_ptr(s->cart, addr);
+    } else if (addr < 0x3f00) {
+        return s->vram[nes_ppu_nt_index(s, addr)];
+    }
+    return s->palette[nes_ppu_palette_index(addr)];
+}
+
+static void nes_ppu_vram_write(NesPPUState *s, uint16_t addr, uint8_t val)
+{
+    addr &= 0x3fff;
+    if (addr < NES_CHR_SIZE) {
+        if (s->cart->chr_writable) {
+            *nes_cartridge_chr_ptr(s->cart, addr) = val;
+        }
+    } else if (addr < 0x3f00) {
+        s->vram[nes_ppu_nt_index(s, addr)] = val;
+    } else {
+        s->palette[nes_ppu_palette_index(addr)] = val & 0x3f;
+    }
+}
+
+/* NMI is asserted while in vertical blank, if enabled */
+static void nes_ppu_update_nmi(NesPPUState *s)
+{
+    qemu_set_irq(s->nmi, (s->status & PPU_STATUS_VBLANK)
+                 && (s->ctrl & PPU_CTRL_NMI));
+}
+
+static void nes_ppu_increment_y(NesPPUState *s)
+{
+    unsigned int coarse_y;
+
+    if ((s->v & 0x7000) != 0x7000) {
+        s->v += 0x1000;
+        return;
+    }
+
+    s->v &= ~0x7000;
+    coarse_y = (s->v >> 5) & 0x1f;
+    if (coarse_y == 29) {
+        coarse_y = 0;
+        s->v ^= 0x0800;
+    } else if (coarse_y == 31) {
+        coarse_y = 0;
+    } else {
+        coarse_y++;
+    }
+    s->v = (s->v & ~0x03e0) | coarse_y << 5;
+}
+
+/*
+ * Background pixels of the line at s->v in @bg, 0 when transparent,
+ * starting s->x pixels before the left edge.
+ */
+static void nes_ppu_render_bg(NesPPUState *s, uint8_t *bg, uint8_t **chr)
+{
+    uint16_t v = s->v;
+    uint16_t pt = s->ctrl & PPU_CTRL_BG_PT ? 0x1000 : 0;
+    unsigned int fine_y = (v >> 12) & 7;
+
+    for (int tile = 0; tile < NES_PPU_WIDTH / 8 + 1; ++tile) {
+        uint8_t index = s->vram[nes_ppu_nt_index(s, 0x2000 | (v & 0x0fff))];
+        uint8_t attr = s->vram[nes_ppu_nt_index(s, 0x23c0 | (v & 0x0c00)
+                                                | ((v >> 4) & 0x38)
+                                                | ((v >> 2) & 0x07))];
+        uint8_t pal = ((attr >> (((v >> 4) & 4) | (v & 2))) & 3) << 2;
+        uint16_t addr = pt | index << 4 | fine_y;
+        uint8_t lo = chr[addr >> 10][addr & 0x3ff];
+        uint8_t hi = chr[(addr + 8) >> 10][(addr + 8) & 0x3ff];
+
+        for (int px = 0; px < 8; ++px) {
+            uint8_t c = ((lo >> (7 - px)) & 1) | ((hi >> (7 - px)) & 1) << 1;
+            bg[tile * 8 + px] = c ? pal | c : 0;
+        }
+
+        /* Next tile, possibly in the next horizontal nametable */
+        if ((v & 0x1f) == 31) {
+            v = (v & ~0x1f) ^ 0x0400;
+        } else {
+            v++;
+        }
+    }
+}
+
+/*
+ * Sprite pixels of line @y in @spr, as palette offsets with bit 7 set when
+ * behind the background. The first sprite in OAM order wins.
+ */
+static void nes_ppu_render_sprites(NesPPUState *s, int y, uint8_t *spr,
+                                   bool *spr0, uint8_t **chr)
+{
+    int height = s->ctrl & PPU_CTRL_SPR_16 ? 16 : 8;
+    int found = 0;
+
+    for (int i = 0; i < NES_PPU_OAM_SIZE / 4; ++i) {
+        const uint8_t *o = &s->oam[i * 4];
+        /* Sprites are delayed by one line */
+        int row = y - (o[0] + 1);
+        uint8_t tile = o[1];
+        uint8_t attr = o[2];
+        uint16_t addr;
+        uint8_t lo, hi;
+
+        if (row < 0 || row >= height) {
+            continue;
+        }
+        if (found++ == 8) {
+            s->status |= PPU_STATUS_OVERFLOW;
+            break;
+        }
+
+        if (attr & 0x80) {
+            row = height - 1 - row;
+        }
+        if (height == 16) {
+            addr = (tile & 1) << 12 | (tile & 0xfe) << 4;
+            if (row >= 8) {
+                addr += 16;
+                row -= 8;
+            }
+        } else {
+            addr = (s->ctrl & PPU_CTRL_SPR_PT ? 0x1000 : 0) | tile << 4;
+        }
+        addr += row;
+        lo = chr[addr >> 10][addr & 0x3ff];
+        hi = chr[(addr + 8) >> 10][(addr + 8) & 0x3ff];
+
+        for (int px = 0; px < 8 && o[3] + px < NES_PPU_WIDTH; ++px) {
+            int x = o[3] + px;
+            int bit = attr & 0x40 ? px : 7 - px;
+            uint8_t c = ((lo >> bit) & 1) | ((hi >> bit) & 1) << 1;
+
+            if (c == 0 || spr[x]) {
+                continue;
+            }
+            spr[x] = 0x10 | (attr & 3) << 2 | c | (attr & 0x20) << 2;
+            spr0[x] = i == 0;
+        }
+    }
+}
+
+static void nes_ppu_render_line(NesPPUState *s, int y)
+{
+    DisplaySurface *surface = qemu_console_surface(s->con);
+    uint32_t *dst = (uint32_t *)(surface_data(surface)
+                                 + y * surface_stride(surface));
+    uint8_t bg[NES_PPU_WIDTH + 8] = { 0 };
+    uint8_t spr[NES_PPU_WIDTH] = { 0 };
+    bool spr0[NES_PPU_WIDTH] = { false };
+    uint8_t gray = s->mask & PPU_MASK_GRAY ? 0x30 : 0x3f;
+    uint8_t *chr[NES_CHR_NB_SLOTS];
+
+    /* Banks can't change within a line */
+    for (int i = 0; i < NES_CHR_NB_SLOTS; ++i) {
+        chr[i] = nes_cartridge_chr_ptr(s->cart, i * NES_CHR_SLOT_SIZE);
+    }
+
+    if (s->mask & PPU_MASK_BG) {
+        nes_ppu_render_bg(s, bg, chr);
+        if (!(s->mask & PPU_MASK_BG_LEFT)) {
+            memset(bg + s->x, 0, 8);
+        }
+    }
+    if (s->mask & PPU_MASK_SPR) {
+        nes_ppu_render_sprites(s, y, spr, spr0, chr);
+        if (!(s->mask & PPU_MASK_SPR_LEFT)) {
+            memset(spr, 0, 8);
+        }
+    }
+
+    for (int x = 0; x < NES_PPU_WIDTH; ++x) {
+        uint8_t b = bg[x + s->x];
+        uint8_t c = b;
+
+        if (spr[x]) {
+            if (b && spr0[x] && x != NES_PPU_WIDTH - 1
+                    && s->sprite0_dot == INT_MAX) {
+                s->sprite0_dot = y * NES_PPU_DOTS_PER_LINE + x + 1;
+            }
+            if (!b || !(spr[x] & 0x80)) {
+                c = spr[x] & 0x1f;
+            }
+        }
+        dst[x] = nes_ppu_rgb[s->palette[nes_ppu_palette_index(c)] & gray];
+    }
+}
+
+static void nes_ppu_process_line(NesPPUState *s, int line)
+{
+    if (line < NES_PPU_HEIGHT) {
+        if (nes_ppu_rendering(s)) {
+            /* The pre-render line reloads the whole of v, others X only */
+            if (line == 0) {
+                s->v = s->t;
+            } else {
+                s->v = (s->v & ~PPU_V_HORIZONTAL) | (s->t & PPU_V_HORIZONTAL);
+            }
+        }
+        nes_ppu_render_line(s, line);
+        if (nes_ppu_rendering(s)) {
+            nes_ppu_increment_y(s);
+            nes_cartridge_scanline(s->cart);
+        }
+    } else if (line == NES_PPU_VBLANK_LINE) {
+        s->status |= PPU_STATUS_VBLANK;
+        nes_ppu_update_nmi(s);
+        s->frame_count++;
+        dpy_gfx_update_full(s->con);
+    } else if (line == NES_PPU_PRERENDER_LINE) {
+        s->status &= ~(PPU_STATUS_VBLANK | PPU_STATUS_SPRITE0 |
+                       PPU_STATUS_OVERFLOW);
+        s->sprite0_dot = INT_MAX;
+        s->sprite0_poll = false;
+        nes_ppu_update_nmi(s);
+        if (nes_ppu_rendering(s)) {
+            nes_cartridge_scanline(s->cart);
+        }
+    }
+}
+
+/*
+ * Process the lines up to the current time. Line events happen on their
+ * first dot. If the PPU is more than a frame late, the frames in between
+ * are dropped. Returns the current dot in the frame.
+ */
+static int nes_ppu_catch_up(NesPPUState *s)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    int64_t frame_ns = nes_ppu_dots_to_ns(NES_PPU_FRAME_DOTS);
+    int dot;
+
+    for (;;) {
+        dot = MIN(nes_ppu_ns_to_dots(now - s->frame_start),
+                  NES_PPU_FRAME_DOTS);
+        while (s->line < NES_PPU_LINES
+               && s->line * NES_PPU_DOTS_PER_LINE + 1 <= dot) {
+            nes_ppu_process_line(s, s->line++);
+        }
+        if (dot < NES_PPU_FRAME_DOTS) {
+            return dot;
+        }
+
+        s->frame_start += frame_ns;
+        s->line = 0;
+        if (now - s->frame_start >= frame_ns) {
+            s->frame_start += (now - s->frame_start) / frame_ns * frame_ns;
+        }
+    }
+}
+
+/*
+ * Arm the timer for the next line with a visible side effect. While the
+ * guest polls the sprite 0 hit, those are the lines sprite 0 covers: each
+ * one is rendered on its first dot, the hit is then known.
+ */
+static void nes_ppu_schedule(NesPPUState *s)
+{
+    int first, last;
+    int next;
+    int dot;
+
+    if (s->line < NES_PPU_HEIGHT && nes_ppu_rendering(s)
+            && s->cart->mapper->scanline) {
+        next = s->line;
+    } else if (s->sprite0_poll && nes_ppu_sprite0_lines(s, &first, &last)) {
+        next = MAX(s->line, first);
+    } else if (s->line <= NES_PPU_VBLANK_LINE) {
+        next = NES_PPU_VBLANK_LINE;
+    } else if (s->line <= NES_PPU_PRERENDER_LINE) {
+        next = NES_PPU_PRERENDER_LINE;
+    } else {
+        next = NES_PPU_LINES;
+    }
+    dot = next * NES_PPU_DOTS_PER_LINE + 1;
+
+    /* The hit is known once its line is rendered, wake up on its dot */
+    if (s->sprite0_poll && s->sprite0_dot < dot) {
+        dot = s->sprite0_dot;
+    }
+
+    timer_mod(s->timer, s->frame_start + nes_ppu_dots_to_ns(dot));
+}
+
+static void nes_ppu_timer(void *opaque)
+{
+    NesPPUState *s = opaque;
+
+    if (nes_ppu_catch_up(s) >= s->sprite0_dot) {
+        s->sprite0_poll = false;
+    }
+    nes_ppu_schedule(s);
+}
+
+static uint64_t nes_ppu_read(void *opaque, hwaddr addr, unsigned size)
+{
+    NesPPUState *s = opaque;
+    int dot = nes_ppu_catch_up(s);
+    int first, last;
+    uint8_t val;
+
+    switch (addr & 7) {
+    case 2:
+        if (dot >= s->sprite0_dot) {
+            s->status |= PPU_STATUS_SPRITE0;
+        }
+        /*
+         * The guest may wait for the hit, which has no timer event of its
+         * own. Have one on the lines sprite 0 covers, so that a CPU parked
+         * in the polling loop is woken up in time. Vertical blank waits
+         * poll too, they cost nothing while sprite 0 is off screen.
+         */
+        if (!(s->status & PPU_STATUS_SPRITE0) && !s->sprite0_poll
+                && nes_ppu_sprite0_lines(s, &first, &last)) {
+            s->sprite0_poll = true;
+            nes_ppu_schedule(s);
+        }
+        val = (s->status & 0xe0) | (s->latch & 0x1f);
+        s->status &= ~PPU_STATUS_VBLANK;
+        s->w = false;
+        nes_ppu_update_nmi(s);
+        break;
+    case 4:
+        val = s->oam[s->oam_addr];
+        break;
+    case 7:
+        if ((s->v & 0x3fff) < 0x3f00) {
+            val = s->read_buffer;
+            s->read_buffer = nes_ppu_vram_read(s, s->v);
+        } else {
+            /* Palette reads are immediate, the buffer gets the nametable */
+            val = nes_ppu_vram_read(s, s->v);
+            s->read_buffer = nes_ppu_vram_read(s, s->v - 0x1000);
+        }
+        s->v = (s->v + (s->ctrl & PPU_CTRL_INC32 ? 32 : 1)) & 0x7fff;
+        break;
+    default:
+        /* Write only */
+        return s->latch;
+    }
+
+    s->latch = val;
+    return val;
+}
+
+static void nes_ppu_write(void *opaque, hwaddr addr, uint64_t val,
+                          unsigned size)
+{
+    NesPPUState *s = opaque;
+
+    nes_ppu_catch_up(s);
+    s->latch = val;
+
+    switch (addr & 7) {
+    case 0:
+        s->ctrl = val;
+        s->t = (s->t & ~0x0c00) | (val & 3) << 10;
+        nes_ppu_update_nmi(s);
+        if (s->sprite0_poll) {
+            /* The sprite height may have changed */
+            nes_ppu_schedule(s);
+        }
+        break;
+    case 1:
+        s->mask = val;
+        /* May start or stop counting scanlines or the sprite 0 hit */
+        nes_ppu_schedule(s);
+        break;
+    case 2:
+        break;
+    case 3:
+        s->oam_addr = val;
+        break;
+    case 4:
+        s->oam[s->oam_addr++] = val;
+        if (s->sprite0_poll) {
+            nes_ppu_schedule(s);
+        }
+        break;
+    case 5:
+        if (!s->w) {
+            s->t = (s->t & ~0x001f) | val >> 3;
+            s->x = val & 7;
+        } else {
+            s->t = (s->t & ~0x73e0) | (val & 7) << 12 | (val & 0xf8) << 2;
+        }
+        s->w = !s->w;
+        break;
+    case 6:
+        if (!s->w) {
+            s->t = (s->t & 0x00ff) | (val & 0x3f) << 8;
+        } else {
+            s->t = (s->t & 0xff00) | val;
+            s->v = s->t;
+        }
+        s->w = !s->w;
+        break;
+    case 7:
+        nes_ppu_vram_write(s, s->v, val);
+        s->v = (s->v + (s->ctrl & PPU_CTRL_INC32 ? 32 : 1)) & 0x7fff;
+        break;
+    }
+}
+
+static const MemoryRegionOps nes_ppu_ops = {
+    .read = nes_ppu_read,
+    .write = nes_ppu_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .valid = {
+        .min_access_size = 1,
+        .max_access_size = 1,
+    },
+};
+
+/*
+ * OAM DMA: copy a CPU page to OAM. The CPU is not stalled for the 513
+ * cycles the transfer takes.
+ */
+static void nes_ppu_dma_write(void *opaque, hwaddr addr, uint64_t val,
+                              unsigned size)
+{
+    NesPPUState *s = opaque;
+    uint8_t buf[NES_PPU_OAM_SIZE];
+
+    nes_ppu_catch_up(s);
+
+    address_space_read(&address_space_memory, (val & 0xff) << 8,
+                       MEMTXATTRS_UNSPECIFIED, buf, sizeof(buf));
+    for (int i = 0; i < NES_PPU_OAM_SIZE; ++i) {
+        s->oam[(s->oam_addr + i) & 0xff] = buf[i];
+    }
+    if (s->sprite0_poll) {
+        /* Sprite 0 may have moved */
+        nes_ppu_schedule(s);
+    }
+}
+
+static uint64_t nes_ppu_dma_read(void *opaque, hwaddr addr, unsigned size)
+{
+    NesPPUState *s = opaque;
+
+    return s->latch;
+}
+
+static const MemoryRegionOps nes_ppu_dma_ops = {
+    .read = nes_ppu_dma_read,
+    .write = nes_ppu_dma_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .valid = {
+        .min_access_size = 1,
+        .max_access_size = 1,
+    },
+};
+
+/* Frames are pushed at vertical blank, only make sure we are up to date */
+static void nes_ppu_gfx_update(void *opaque)
+{
+    NesPPUState *s = opaque;
+
+    nes_ppu_catch_up(s);
+}
+
+static const GraphicHwOps nes_ppu_gfx_ops = {
+    .gfx_update = nes_ppu_gfx_update,
+};
+
+static void nes_ppu_reset(void *opaque)
+{
+    NesPPUState *s = opaque;
+
+    s->ctrl = 0;
+    s->mask = 0;
+    s->status = 0;
+    s->latch = 0;
+    s->read_buffer = 0;
+    s->w = false;
+
+    s->frame_start = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    s->line = 0;
+    s->sprite0_dot = INT_MAX;
+    s->sprite0_poll = false;
+    nes_ppu_update_nmi(s);
+    nes_ppu_schedule(s);
+}
+
+/*
+ * The NMI line is not driven again: the CPU keeps its level. The frame is
+ * pushed to the display at the next vertical blank.
+ */
+static int nes_ppu_post_load(void *opaque, int version_id)
+{
+    nes_ppu_schedule(opaque);
+    return 0;
+}
+
+static void nes_ppu_snapshot_restore(void *opaque, int64_t delta)
+{
+    NesPPUState *s = opaque;
+
+    s->frame_start += delta;
+    nes_ppu_schedule(s);
+}
+
+static const VMStateDescription vmstate_nes_ppu = {
+    .name = TYPE_NES_PPU,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = nes_ppu_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT8(ctrl, NesPPUState),
+        VMSTATE_UINT8(mask, NesPPUState),
+        VMSTATE_UINT8(status, NesPPUState),
+        VMSTATE_UINT8(oam_addr, NesPPUState),
+        VMSTATE_UINT8(latch, NesPPUState),
+        VMSTATE_UINT8(read_buffer, NesPPUState),
+        VMSTATE_UINT16(v, NesPPUState),
+        VMSTATE_UINT16(t, NesPPUState),
+        VMSTATE_UINT8(x, NesPPUState),
+        VMSTATE_BOOL(w, NesPPUState),
+        VMSTATE_UINT8_ARRAY(vram, NesPPUState, NES_PPU_VRAM_SIZE),
+        VMSTATE_UINT8_ARRAY(oam, NesPPUState, NES_PPU_OAM_SIZE),
+        VMSTATE_UINT8_ARRAY(palette, NesPPUState, NES_PPU_PALETTE_SIZE),
+        VMSTATE_INT64(frame_start, NesPPUState),
+        VMSTATE_INT32(line, NesPPUState),
+        VMSTATE_INT32(sprite0_dot, NesPPUState),
+        VMSTATE_BOOL(sprite0_poll, NesPPUState),
+        VMSTATE_UINT64(frame_count, NesPPUState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void nes_ppu_init(Object *obj)
+{
+    NesPPUState *s = NES_PPU(obj);
+
+    qdev_init_gpio_out(DEVICE(s), &s->nmi, 1);
+}
+
+static void nes_ppu_realize(DeviceState *dev, Error **errp)
+{
+    NesPPUState *s = NES_PPU(dev);
+
+    if (s->cart == NULL) {
+        error_setg(errp, "PPU has no cartridge");
+        return;
+    }
+
+    memory_region_init_io(&s->regs, OBJECT(s), &nes_ppu_ops, s, "PPU",
+                          PPU_REGS_SIZE);
+    memory_region_init_io(&s->dma, OBJECT(s), &nes_ppu_dma_ops, s, "OAM DMA",
+                          1);
+
+    s->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, nes_ppu_timer, s);
+    s->con = graphic_console_init(dev, 0, &nes_ppu_gfx_ops, s);
+    qemu_console_resize(s->con, NES_PPU_WIDTH, NES_PPU_HEIGHT);
+
+    /* Everything from the registers on */
+    mcs6500_snapshot_add(&s->ctrl,
+                         sizeof(*s) - offsetof(NesPPUState, ctrl));
+    mcs6500_snapshot_add_restore(nes_ppu_snapshot_restore, s);
+
+    qemu_register_reset(nes_ppu_reset, s);
+}
+
+static void nes_ppu_class_init(ObjectClass *oc, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(oc);
+
+    dc->realize = nes_ppu_realize;
+    dc->vmsd = &vmstate_nes_ppu;
+    dc->desc = "Nes 2C02 PPU";
+    dc->user_creatable = false;
+}
+
+static const TypeInfo nes_ppu_type_info = {
+    .name = TYPE_NES_PPU,
+    .parent = TYPE_DEVICE,
+    .instance_size = sizeof(NesPPUState),
+    .instance_init = nes_ppu_init,
+    .class_init = nes_ppu_class_init,
+};
+
+static void nes_ppu_register_types(void)
+{
+    type_register_static(&nes_ppu_type_info);
+}
+
+type_init(nes_ppu_register_types)
@@ -28,12 +28,22 @@
 #include "sysemu/sysemu.h"
 #include "target/mcs6500/cpu.h"
 #include "hw/mcs6500/nes-cartridge.h"
+#include "hw/mcs6500/nes-ppu.h"
+#include "hw/mcs6500/nes-apu.h"
+#include "hw/mcs6500/nes-pad.h"
+#include "hw/or-irq.h"
+#include "hw/mcs6500/batch.h"
+#include "hw/mcs6500/snapshot.h"
 
 static void nes_init(MachineState *machine)
 {
     SocMCS6500State *cpu;
     MemoryRegion *mirrors;
     NesCartridgeState *cartridge;
+    NesPPUState *ppu;
+    NesAPUState *apu;
+    NesPadState *pad;
+    DeviceState *irq;
     Error *err = NULL;
     const char *bios_name = machine->firmware;
 
@@ -43,10 +53,17 @@ static void nes_init(MachineState *machine)
     }
 
     cpu = SOC_MCS6500(object_new(TYPE_SOC_MCS6500));
+    cpu->cpu_type = machine->cpu_type;
     object_property_add_child(OBJECT(machine), "soc", OBJECT(cpu));
     object_property_set_bool(OBJECT(cpu), "realized", true, &err);
     object_unref(OBJECT(cpu));
 
+    memory_region_add_subregion(get_system_memory(), NES_BASE_RAM_ADDR,
+            machine->ram);
+    /* Zero page and stack are plain RAM */
+    mcs6500_cpu_set_zp_ram(cpu->cpu, memory_region_get_ram_ptr(machine->ram));
+    mcs6500_snapshot_add_ram(machine->ram);
+
     mirrors = g_new0(MemoryRegion, NES_NB_MIRRORS);
     for (uint8_t i = 0 ; i < NES_NB_MIRRORS ; ++i) {
         char name[] = "mem_aliasN";
@@ -60,15 +77,64 @@ static void nes_init(MachineState *machine)
     cartridge = NES_CARTRIDGE(object_new(TYPE_NES_CARTRIDGE));
     cartridge->rom_path = strdup(bios_name);
     object_property_add_child(OBJECT(machine), "cartridge", OBJECT(cartridge));
-    object_property_set_bool(OBJECT(cartridge), "realized", true, &err);
+    object_property_set_bool(OBJECT(cartridge), "realized", true, &error_fatal);
     object_unref(OBJECT(cartridge));
+
+    /* The IRQ line is shared by the mapper and the APU */
+    irq = DEVICE(object_new(TYPE_OR_IRQ));
+    object_property_add_child(OBJECT(machine), "irq", OBJECT(irq));
+    object_property_set_int(OBJECT(irq), "num-lines", NES_NB_IRQS,
+                            &error_fatal);
+    object_property_set_bool(OBJECT(irq), "realized", true, &error_fatal);
+    object_unref(OBJECT(irq));
+    mcs6500_snapshot_add(OR_IRQ(irq)->levels, sizeof(OR_IRQ(irq)->levels));
+    qdev_connect_gpio_out(irq, 0,
+                          qdev_get_gpio_in(DEVICE(cpu->cpu), MCS6500_CPU_IRQ));
+
+    /* Mapper IRQ, MMC3 scanline counter */
+    qdev_connect_gpio_out(DEVICE(cartridge), 0,
+                          qdev_get_gpio_in(irq, NES_IRQ_MAPPER));
+
+    ppu = NES_PPU(object_new(TYPE_NES_PPU));
+    ppu->cart = cartridge;
+    object_property_add_child(OBJECT(machine), "ppu", OBJECT(ppu));
+    object_property_set_bool(OBJECT(ppu), "realized", true, &error_fatal);
+    object_unref(OBJECT(ppu));
+    memory_region_add_subregion(get_system_memory(), NES_PPU_BASE, &ppu->regs);
+    memory_region_add_subregion_overlap(get_system_memory(), NES_OAM_DMA_ADDR,
+                                        &ppu->dma, 1);
+    /* Vertical blank NMI */
+    qdev_connect_gpio_out(DEVICE(ppu), 0,
+                          qdev_get_gpio_in(DEVICE(cpu->cpu), MCS6500_CPU_NMI));
+
+    apu = NES_APU(object_new(TYPE_NES_APU));
+    object_property_add_child(OBJECT(machine), "apu", OBJECT(apu));
+    object_property_set_bool(OBJECT(apu), "realized", true, &error_fatal);
+    object_unref(OBJECT(apu));
+    /* Below the OAM DMA register, which sits in the middle */
+    memory_region_add_subregion(get_system_memory(), NES_APU_BASE, &apu->regs);
+    /* Frame counter and DMC IRQ */
+    qdev_connect_gpio_out(DEVICE(apu), 0,
+                          qdev_get_gpio_in(irq, NES_IRQ_APU));
+
+    pad = NES_PAD(object_new(TYPE_NES_PAD));
+    pad->apu = &apu->regs;
+    pad->ppu = ppu;
+    object_property_add_child(OBJECT(machine), "pad", OBJECT(pad));
+    object_property_set_bool(OBJECT(pad), "realized", true, &error_fatal);
+    object_unref(OBJECT(pad));
+    /* Over the APU, which still gets the writes to 0x4017 */
+    memory_region_add_subregion_overlap(get_system_memory(), NES_PAD_ADDR,
+                                        &pad->regs, 1);
+
+    mcs6500_batch_init(cpu->cpu, machine->ram, ppu->con);
 }
 
 static void nes_machine_init(MachineClass *mc)
 {
     mc->desc = "Nitendo Nes";
     mc->init = nes_init;
-    mc->default_cpu_type = TYPE_MCS6500_CPU;
+    mc->default_cpu_type = MCS6500_CPU_TYPE_NAME("2a03");
     mc->default_ram_size = NES_RAM_SIZE;
     mc->default_ram_id = "nes.ram";
 }
@@ -0,0 +1,167 @@
+/*
+ * In-memory snapshots of mcs6500 machines
+ *
+ * Copyright (c) 2020 Alexandre Guyon
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/timer.h"
+#include "exec/ram_addr.h"
+#include "hw/mcs6500/snapshot.h"
+
+/*
+ * A whole machine holds in a few dozen KiB, which savevm streams field by
+ * field through a QEMUFile. For tools which rewind the guest many times per
+ * second, devices also register the areas of their state which can be
+ * copied as they are: a snapshot is a flat copy of those areas, restored
+ * with memcpy() and a callback for each device to rebuild what derives
+ * from its state, such as timers and memory mappings.
+ *
+ * Guest RAM is compared page by page on restore: only the pages which
+ * differ are written back, and the code translated from them discarded.
+ *
+ * Snapshots are taken and restored with the BQL held and the vCPUs paused,
+ * as the x-mcs6500-snapshot-save and x-mcs6500-snapshot-load commands do.
+ */
+
+typedef struct {
+    uint8_t *base;
+    size_t size;
+    MemoryRegion *ram; /* Guest RAM, which may hold code */
+} MCS6500SnapshotArea;
+
+typedef struct {
+    MCS6500SnapshotRestore *fn;
+    void *opaque;
+} MCS6500SnapshotHandler;
+
+struct MCS6500Snapshot {
+    int64_t clock;
+    uint8_t data[];
+};
+
+static GArray *areas;
+static GArray *handlers;
+static size_t snapshot_size;
+
+static void mcs6500_snapshot_add_area(void *base, size_t size,
+                                      MemoryRegion *ram)
+{
+    MCS6500SnapshotArea area = {
+        .base = base,
+        .size = size,
+        .ram = ram,
+    };
+
+    if (areas == NULL) {
+        areas = g_array_new(false, false, sizeof(MCS6500SnapshotArea));
+    }
+    g_array_append_val(areas, area);
+    snapshot_size += size;
+}
+
+/* Device state at @base, without pointers nor host resources */
+void mcs6500_snapshot_add(void *base, size_t size)
+{
+    mcs6500_snapshot_add_area(base, size, NULL);
+}
+
+void mcs6500_snapshot_add_ram(MemoryRegion *mr)
+{
+    mcs6500_snapshot_add_area(memory_region_get_ram_ptr(mr),
+                              memory_region_size(mr), mr);
+}
+
+/* Handlers are called in the order they were added */
+void mcs6500_snapshot_add_restore(MCS6500SnapshotRestore *fn, void *opaque)
+{
+    MCS6500SnapshotHandler handler = {
+        .fn = fn,
+        .opaque = opaque,
+    };
+
+    if (handlers == NULL) {
+        handlers = g_array_new(false, false, sizeof(MCS6500SnapshotHandler));
+    }
+    g_array_append_val(handlers, handler);
+}
+
+/* A snapshot of the areas added so far, to be filled by *_save() */
+MCS6500Snapshot *mcs6500_snapshot_new(void)
+{
+    return g_malloc0(sizeof(MCS6500Snapshot) + snapshot_size);
+}
+
+void mcs6500_snapshot_free(MCS6500Snapshot *snap)
+{
+    g_free(snap);
+}
+
+void mcs6500_snapshot_save(MCS6500Snapshot *snap)
+{
+    uint8_t *data = snap->data;
+
+    for (int i = 0; areas && i < areas->len; ++i) {
+        MCS6500SnapshotArea *area = &g_array_index(areas, MCS6500SnapshotArea,
+                                                   i);
+
+        memcpy(data, area->base, area->size);
+        data += area->size;
+    }
+    snap->clock = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+}
+
+static void mcs6500_snapshot_load_ram(MCS6500SnapshotArea *area,
+                                      const uint8_t *data)
+{
+    ram_addr_t base = memory_region_get_ram_addr(area->ram);
+
+    for (size_t offset = 0; offset < area->size; offset += TARGET_PAGE_SIZE) {
+        size_t len = MIN(TARGET_PAGE_SIZE, area->size - offset);
+
+        if (memcmp(area->base + offset, data + offset, len) == 0) {
+            continue;
+        }
+        memcpy(area->base + offset, data + offset, len);
+        tb_invalidate_phys_range(base + offset, base + offset + len);
+        cpu_physical_memory_set_dirty_range(base + offset, len,
+                                            DIRTY_CLIENTS_NOCODE);
+    }
+}
+
+void mcs6500_snapshot_load(MCS6500Snapshot *snap)
+{
+    const uint8_t *data = snap->data;
+    int64_t delta = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) - snap->clock;
+
+    for (int i = 0; areas && i < areas->len; ++i) {
+        MCS6500SnapshotArea *area = &g_array_index(areas, MCS6500SnapshotArea,
+                                                   i);
+
+        if (area->ram) {
+            mcs6500_snapshot_load_ram(area, data);
+        } else {
+            memcpy(area->base, data, area->size);
+        }
+        data += area->size;
+    }
+
+    for (int i = 0; handlers && i < handlers->len; ++i) {
+        MCS6500SnapshotHandler *handler =
+            &g_array_index(handlers, MCS6500SnapshotHandler, i);
+
+        handler->fn(handler->opaque, delta);
+    }
+}
@@ -5,20 +5,9 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <sys/mman.h>
 #include "hw/video-games/ines.h"
 
-#define DEBUG
-#ifdef DEBUG
-#include <stdio.h>
-
-#define debug printf
-
-#define INES_FLAG6_MIRRORING_H_VALUE 0
-#define INES_FLAG6_MIRRORING_H_NAME "horizontal mirroring"
-#define INES_FLAG6_MIRRORING_V_VALUE 1
-#define INES_FLAG6_MIRRORING_V_NAME "vertical mirroring"
-#endif // DEBUG
-
 /*
  * iNES format: http://fms.komkon.org/EMUL8/NES.html#LABM
  */
@@ -61,13 +50,27 @@ struct iNesHeader {
     uint8_t padding[6];
 };
 
-struct iNes {
-    struct iNesHeader header;
+#define INES_TRAINER_SIZE 512
+
+/*
+ * A loaded image: the file is mapped read-only and the sections point in
+ * the mapping, so the ROM contents are only held by the page cache. Images
+ * are shared by path between the cartridges of the process.
+ */
+struct ines_file {
+    const struct iNesHeader *header;
     uint8_t *trainer;
     uint8_t *prg_rom;
     uint8_t *chr_rom;
     uint8_t *inst_rom;
     uint8_t *prom;
+
+    void *map;
+    size_t map_size;
+    dev_t dev;
+    ino_t ino;
+    unsigned int refcount;
+    struct ines_file *next;
 };
 
 #define INES_MAX_SECTION 4
@@ -79,57 +82,96 @@ struct mapper_support {
     struct ines_mapper_section sections[INES_MAX_SECTION];
 };
 
+/*
+ * All the supported mappers share the same CPU layout, only the way they
+ * switch banks inside it differs.
+ */
+#define INES_CARTRIDGE_SECTIONS                 \
+    .nb_sections = 2,                           \
+    .sections = {                               \
+        {                                       \
+            .section_id = INES_SECTION_PRG_RAM, \
+            .start = 0x6000,                    \
+            .end = 0x7FFF                       \
+        },                                      \
+        {                                       \
+            .section_id = INES_SECTION_PRG_ROM, \
+            .start = 0x8000,                    \
+            .end = 0xFFFF                       \
+        }                                       \
+    }
+
 const struct mapper_support mappers[] = {
     {
         .support = 0,
-        .mapper_id = 0x0,
-        .nb_sections = 2,
-        .sections = {
-            {
-                .section_id = INES_SECTION_PRG_RAM,
-                .start = 0x6000,
-                .end = 0x7FFF
-            },
-            {
-                .section_id = INES_SECTION_PRG_ROM,
-                .start = 0x8000,
-                .end = 0xFFFF
-            }
-        }
+        .mapper_id = INES_MAPPER_NROM,
+        INES_CARTRIDGE_SECTIONS
+    },
+    {
+        .support = 0,
+        .mapper_id = INES_MAPPER_MMC1,
+        INES_CARTRIDGE_SECTIONS
+    },
+    {
+        .support = 0,
+        .mapper_id = INES_MAPPER_UXROM,
+        INES_CARTRIDGE_SECTIONS
+    },
+    {
+        .support = 0,
+        .mapper_id = INES_MAPPER_CNROM,
+        INES_CARTRIDGE_SECTIONS
+    },
+    {
+        .support = 0,
+        .mapper_id = INES_MAPPER_MMC3,
+        INES_CARTRIDGE_SECTIONS
     }
 };
 
-static int ines_fd = -1;
-static struct iNes loaded = { 0 };
+static struct ines_file *opened;
 
-static int extract_prg_rom(void)
+static size_t prg_rom_size(const struct ines_file *ines)
 {
-    /* ines_fd must be open and header already read */
-    ssize_t s = loaded.header.prg_rom_size * INES_CHR_ROM_MULTIPLIER * 1024;
-    loaded.prg_rom = malloc(s);
-    s = read(ines_fd, loaded.prg_rom, s);
-    if (s < 0) {
-        free(loaded.prg_rom);
-        loaded.prg_rom = 0;
-        return -1;
-    }
-    return 0;
+    return ines->header->prg_rom_size * INES_PRG_ROM_MULTIPLIER * 1024;
+}
+
+static size_t chr_rom_size(const struct ines_file *ines)
+{
+    return ines->header->chr_rom_size * INES_CHR_ROM_MULTIPLIER * 1024;
 }
 
-static int extract_chr_rom(void)
+/* Point the sections in the mapping, they follow the header in this order */
+static int map_sections(struct ines_file *ines)
 {
-    /* ines_fd must be open and header, chr_rom already read */
-    ssize_t s = loaded.header.chr_rom_size * INES_CHR_ROM_MULTIPLIER * 1024;
-    loaded.chr_rom = malloc(s);
-    s = read(ines_fd, loaded.chr_rom, s);
-    if (s < 0) {
-        free(loaded.chr_rom);
-        loaded.chr_rom = 0;
-        return -1;
+    size_t offset = sizeof(struct iNesHeader);
+
+    if (ines->header->flag6_trainer) {
+        ines->trainer = (uint8_t *)ines->map + offset;
+        offset += INES_TRAINER_SIZE;
+    }
+
+    ines->prg_rom = (uint8_t *)ines->map + offset;
+    offset += prg_rom_size(ines);
+
+    if (chr_rom_size(ines) != 0) {
+        /* Otherwise the board has CHR RAM */
+        ines->chr_rom = (uint8_t *)ines->map + offset;
+        offset += chr_rom_size(ines);
     }
+
+    if (offset > ines->map_size)
+        return -EINVAL;
+
     return 0;
 }
 
+static uint8_t get_mapper_id(const struct ines_file *ines)
+{
+    return ines->header->flag7_upper_mapper_nibble << 4
+        | ines->header->flag6_low_mapper_nibble;
+}
+
 static int get_mapper_idx(uint8_t id)
 {
     int i = 0;
@@ -141,92 +183,110 @@ static int get_mapper_idx(uint8_t id)
     return i;
 }
 
-int ines_load_file(const char *path)
+int ines_load_file(const char *path, struct ines_file **ines_ret)
 {
-    ssize_t size_ret;
+    struct ines_file *ines;
+    struct stat st;
+    void *map;
+    int fd;
     int ret = 0;
 
-    ines_fd = open(path, O_RDONLY);
-    if (ines_fd < 0) {
-        return ines_fd;
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -errno;
     }
 
-    size_ret = read(ines_fd, &loaded, sizeof(loaded.header));
-    if (size_ret < 0) {
-        return size_ret;
+    if (fstat(fd, &st) < 0) {
+        ret = -errno;
+        close(fd);
+        return ret;
     }
 
-#if defined DEBUG
-    debug("PRG_ROM size = %d Kio\n", loaded.header.prg_rom_size * INES_PRG_ROM_MULTIPLIER);
-    debug("CHR_ROM size = %d Kio\n", loaded.header.chr_rom_size * INES_CHR_ROM_MULTIPLIER);
-    debug("Flag 6:\n");
-    debug("\tMirroring = %s\n", loaded.header.flag6_mirroring ? INES_FLAG6_MIRRORING_V_NAME :
-            INES_FLAG6_MIRRORING_H_NAME);
-    debug("\tPersistant = %d\n", loaded.header.flag6_persitant);
-    debug("\tTrainer = %d\n", loaded.header.flag6_trainer);
-    debug("\t4 Screen VRAM = %d\n", loaded.header.flag6_4screen_vram);
-    debug("\tLow mapper nibble = %x\n", loaded.header.flag6_low_mapper_nibble);
-    debug("Flag 7:\n");
-    debug("\tVS Unisystem = %d\n", loaded.header.flag7_vs_inusystem);
-    debug("\tPlaychoice 10 = %d\n", loaded.header.flag7_playchoice10);
-    debug("\tiNes version = %x\n", loaded.header.flag7_ines_version);
-    debug("\tUpper mapper nibble = %x\n", loaded.header.flag7_upper_mapper_nibble);
-    debug("Flag 8: PRG_RAM size = %d Kio\n", loaded.header.flag8_prg_ram_size * INES_PRG_RAM_MULTIPLIER);
-    debug("Flag 9: tv system = %d\n", loaded.header.flag9_tv_system);
-#endif // DEBUG
-
-    ret = ines_is_supported();
-    if (ret < 0) {
-        goto reset;
+    for (ines = opened; ines != NULL; ines = ines->next) {
+        if (ines->dev == st.st_dev && ines->ino == st.st_ino) {
+            close(fd);
+            ines->refcount++;
+            *ines_ret = ines;
+            return 0;
+        }
+    }
+
+    if (st.st_size < sizeof(struct iNesHeader)) {
+        close(fd);
+        return -EINVAL;
+    }
+
+    /* The mapping keeps the file referenced */
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ret = -errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        return ret;
     }
 
-    ret = extract_prg_rom();
+    ines = calloc(1, sizeof(*ines));
+    if (ines == NULL) {
+        munmap(map, st.st_size);
+        return -ENOMEM;
+    }
+    ines->map = map;
+    ines->map_size = st.st_size;
+    ines->header = map;
+    ines->dev = st.st_dev;
+    ines->ino = st.st_ino;
+    ines->refcount = 1;
+
+    ret = ines_is_supported(ines);
     if (ret < 0) {
         goto reset;
     }
 
-    ret = extract_chr_rom();
+    ret = map_sections(ines);
     if (ret < 0) {
         goto reset;
     }
 
+    ines->next = opened;
+    opened = ines;
+    *ines_ret = ines;
+
     return 0;
 
 reset:
-    ines_close_file();
+    munmap(ines->map, ines->map_size);
+    free(ines);
     return ret;
 }
 
-void ines_close_file(void)
+void ines_close_file(struct ines_file *ines)
 {
-    close(ines_fd);
+    struct ines_file **prev;
 
-    if (loaded.prg_rom != 0) {
-        free(loaded.prg_rom);
-        loaded.prg_rom = 0;
-    }
+    if (--ines->refcount > 0)
+        return;
 
-    if (loaded.chr_rom != 0) {
-        free(loaded.chr_rom);
-        loaded.chr_rom = 0;
-    }
+    for (prev = &opened; *prev != ines; prev = &(*prev)->next)
+        ;
+    *prev = ines->next;
+
+    munmap(ines->map, ines->map_size);
+    free(ines);
 }
 
-int ines_is_supported(void)
+int ines_is_supported(const struct ines_file *ines)
 {
     int ret = 0;
-    char mapper_id = loaded.header.flag7_upper_mapper_nibble << 4
-        | loaded.header.flag6_low_mapper_nibble;
+    const struct iNesHeader *header = ines->header;
 
     /* Check magic */
-    if (loaded.header.magic[0] != INES_MAGIC1
-            || loaded.header.magic[1] != INES_MAGIC2
-            || loaded.header.magic[2] != INES_MAGIC3
-            || loaded.header.magic[3] != INES_MAGIC4)
+    if (header->magic[0] != INES_MAGIC1
+            || header->magic[1] != INES_MAGIC2
+            || header->magic[2] != INES_MAGIC3
+            || header->magic[3] != INES_MAGIC4)
         return -EINVAL;
 
     /* Check if mapper is supported */
-    ret = get_mapper_idx(mapper_id);
+    ret = get_mapper_idx(get_mapper_id(ines));
     if (ret < 0) {
         return ret;
     }
@@ -234,32 +294,63 @@ int ines_is_supported(void)
     return 0;
 }
 
-int ines_get_sections(const struct ines_mapper_section **sections)
+int ines_get_sections(const struct ines_file *ines,
+                      const struct ines_mapper_section **sections)
 {
     int mapper_idx;
-    char mapper_id = loaded.header.flag7_upper_mapper_nibble << 4
-        | loaded.header.flag6_low_mapper_nibble;
 
-    mapper_idx = get_mapper_idx(mapper_id);
+    mapper_idx = get_mapper_idx(get_mapper_id(ines));
+    if (mapper_idx < 0) {
+        return mapper_idx;
+    }
     *sections = mappers[mapper_idx].sections;
 
     return mappers[mapper_idx].nb_sections;
 }
 
-int ines_get_section_by_id(uint8_t id, void **rom, size_t *size)
+int ines_get_section_by_id(const struct ines_file *ines, uint8_t id,
+                           void **rom, size_t *size)
 {
     int ret = 0;
 
-    ret = ines_is_supported();
+    ret = ines_is_supported(ines);
     if (ret < 0) {
         return ret;
     }
 
-    if (id != INES_SECTION_PRG_ROM)
+    switch (id) {
+    case INES_SECTION_PRG_ROM:
+        *rom = ines->prg_rom;
+        *size = prg_rom_size(ines);
+        break;
+    case INES_SECTION_CHR_ROM:
+        if (ines->chr_rom == 0)
+            return -ENOENT;
+        *rom = ines->chr_rom;
+        *size = chr_rom_size(ines);
+        break;
+    default:
         return -ENOENT;
-
-    *rom = loaded.prg_rom;
-    *size = loaded.header.prg_rom_size;
+    }
 
     return 0;
 }
+
+int ines_get_mapper_id(const struct ines_file *ines)
+{
+    int ret = ines_is_supported(ines);
+    if (ret < 0) {
+        return ret;
+    }
+
+    return get_mapper_id(ines);
+}
+
+int ines_get_mirroring(const struct ines_file *ines)
+{
+    if (ines->header->flag6_4screen_vram)
+        return INES_MIRRORING_4SCREEN;
+
+    return ines->header->flag6_mirroring ? INES_MIRRORING_VERTICAL
+        : INES_MIRRORING_HORIZONTAL;
+}
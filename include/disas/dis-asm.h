@@ -253,6 +253,11 @@ enum bfd_architecture
 #define bfd_mach_rx            0x75
 #define bfd_mach_rx_v2         0x76
 #define bfd_mach_rx_v3         0x77
+  bfd_arch_mcs6500,  /* MOS 6502 family */
+#define bfd_mach_mcs6500_undoc     (1 << 1)
+#define bfd_mach_mcs6500_cmos      (1 << 2)
+#define bfd_mach_mcs6500_bit_ops   (1 << 3)
+#define bfd_mach_mcs6500_wait_stop (1 << 4)
   bfd_arch_last
   };
 #define bfd_mach_s390_31 31
@@ -461,6 +466,7 @@ int print_insn_riscv32          (bfd_vma, disassemble_info*);
 int print_insn_riscv64          (bfd_vma, disassemble_info*);
 int print_insn_rx(bfd_vma, disassemble_info *);
 int print_insn_hexagon(bfd_vma, disassemble_info *);
+int print_insn_mcs6500(bfd_vma, disassemble_info *);
 
 #ifdef CONFIG_CAPSTONE
 bool cap_disas_target(disassemble_info *info, uint64_t pc, size_t size);
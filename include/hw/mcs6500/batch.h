@@ -0,0 +1,28 @@
+/*
+ * Batch runs of mcs6500 machines
+ *
+ * Copyright (c) 2020 Alexandre Guyon
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MCS6500_BATCH_H
+#define MCS6500_BATCH_H
+
+#include "exec/memory.h"
+#include "ui/console.h"
+#include "cpu.h"
+
+void mcs6500_batch_init(MCS6500CPU *cpu, MemoryRegion *ram, QemuConsole *con);
+
+#endif // MCS6500_BATCH_H
@@ -30,6 +30,9 @@ typedef struct {
 
     /*< public >*/
     MCS6500CPU *cpu;
+    const char *cpu_type;
+    /* Address space of the CPU, the system memory if NULL */
+    MemoryRegion *memory;
 } SocMCS6500State;
 
 #endif // MCS6500_H
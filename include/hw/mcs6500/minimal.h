@@ -20,6 +20,9 @@
 
 #include "hw/boards.h"
 
+#define MINIMAL_RAM_SIZE 0x10000 /* The whole address space */
+#define MINIMAL_MAX_INSTANCES 1024 /* One per CPU */
+
 typedef struct {
     /*< private >*/
     DeviceState parent_obj;
@@ -0,0 +1,144 @@
+/*
+ * Nintendo Nes 2A03 APU
+ *
+ * Copyright (c) 2020 Alexandre Guyon
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NES_APU_H
+#define NES_APU_H
+
+#include "hw/qdev-core.h"
+#include "hw/irq.h"
+#include "exec/memory.h"
+#include "qemu/timer.h"
+#include "audio/audio.h"
+
+#define TYPE_NES_APU "nes-apu"
+#define NES_APU(obj) OBJECT_CHECK(NesAPUState, (obj), TYPE_NES_APU)
+
+#define NES_APU_FREQ 1789773 /* NTSC CPU clock, 21.477272 MHz / 12 */
+#define NES_APU_RATE 44100
+#define NES_APU_BUFFER_SIZE 4096 /* Samples, about 90 ms */
+
+/* 0x4000-0x4017, the OAM DMA and controller ports are mapped over it */
+#define NES_APU_REGS_SIZE 0x18
+
+typedef struct NesAPUEnvelope {
+    bool start;
+    bool loop;          /* Also halts the length counter */
+    bool constant;
+    uint8_t volume;     /* Constant volume or envelope period */
+    uint8_t divider;
+    uint8_t decay;
+} NesAPUEnvelope;
+
+/*
+ * Timers are not counted down cycle by cycle: @phase is how far the channel
+ * is into its current step, in 16.16 fixed point CPU cycles, and advances by
+ * a sample period at a time.
+ */
+typedef struct NesAPUPulse {
+    NesAPUEnvelope env;
+    uint8_t duty;
+    uint8_t step;
+    uint16_t timer;
+    uint32_t phase;
+    uint8_t length;
+    bool sweep_enabled;
+    bool sweep_negate;
+    bool sweep_reload;
+    uint8_t sweep_period;
+    uint8_t sweep_shift;
+    uint8_t sweep_divider;
+} NesAPUPulse;
+
+typedef struct NesAPUTriangle {
+    bool control;       /* Also halts the length counter */
+    bool linear_reload;
+    uint8_t linear_period;
+    uint8_t linear;
+    uint8_t step;
+    uint16_t timer;
+    uint32_t phase;
+    uint8_t length;
+} NesAPUTriangle;
+
+typedef struct NesAPUNoise {
+    NesAPUEnvelope env;
+    bool mode;
+    uint8_t period;
+    uint16_t lfsr;
+    uint32_t phase;
+    uint8_t length;
+} NesAPUNoise;
+
+typedef struct NesAPUDmc {
+    bool irq_enabled;
+    bool loop;
+    bool irq;
+    uint8_t rate;
+    uint8_t level;
+    uint16_t sample_addr;
+    uint16_t sample_length;
+    uint16_t addr;
+    uint16_t remaining;
+    uint8_t shift;
+    uint8_t bits;
+    uint8_t buffer;
+    bool buffer_full;
+    bool silence;
+    uint32_t phase;
+} NesAPUDmc;
+
+typedef struct {
+    /*< private >*/
+    DeviceState parent_obj;
+
+    /*< public >*/
+    MemoryRegion regs;
+    QEMUSoundCard card;
+    SWVoiceOut *voice;
+    QEMUTimer *timer;
+    qemu_irq irq;
+
+    NesAPUPulse pulse[2];
+    NesAPUTriangle triangle;
+    NesAPUNoise noise;
+    NesAPUDmc dmc;
+    uint8_t enabled;    /* Channels enabled by 0x4015 */
+    bool five_step;
+    bool irq_inhibit;
+    bool frame_irq;
+
+    /*
+     * Catch-up state: cycle 0 was at @start on the virtual clock, samples
+     * have been generated up to @cycle. The frame sequence started at
+     * @seq_start and is at step @seq_step.
+     */
+    int64_t start;
+    uint64_t cycle;
+    uint64_t seq_start;
+    int seq_step;
+    uint64_t sample_frac; /* Cycles into the next sample, times the rate */
+    int32_t dc_in;      /* DC blocker state */
+    int32_t dc_out;
+
+    /* Samples waiting for the audio backend */
+    int16_t samples[NES_APU_BUFFER_SIZE];
+    unsigned int head;
+    unsigned int count;
+} NesAPUState;
+
+#endif // NES_APU_H
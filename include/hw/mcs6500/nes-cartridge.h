@@ -2,19 +2,83 @@
 #define NES_CARTRIDGE_H
 
 #include "hw/qdev-core.h"
+#include "hw/irq.h"
 #include "exec/memory.h"
+#include "hw/mcs6500/nes-mapper.h"
+#include "hw/video-games/ines.h"
 
 #define TYPE_NES_CARTRIDGE "nescartridge"
 #define NES_CARTRIDGE(obj) OBJECT_CHECK(NesCartridgeState, (obj), TYPE_NES_CARTRIDGE)
 
-typedef struct {
+/* PRG ROM is switched by 8 KiB slots in 0x8000-0xFFFF */
+#define NES_PRG_BASE 0x8000
+#define NES_PRG_SLOT_SIZE 0x2000
+#define NES_PRG_NB_SLOTS 4
+
+/* CHR is switched by 1 KiB slots in the PPU pattern tables, 0x0000-0x1FFF */
+#define NES_CHR_SLOT_SIZE 0x0400
+#define NES_CHR_NB_SLOTS 8
+#define NES_CHR_SIZE (NES_CHR_SLOT_SIZE * NES_CHR_NB_SLOTS)
+
+/* Nametable layout, as seen by the PPU */
+typedef enum {
+    NES_MIRRORING_HORIZONTAL,
+    NES_MIRRORING_VERTICAL,
+    NES_MIRRORING_SINGLE_LOW,
+    NES_MIRRORING_SINGLE_HIGH,
+    NES_MIRRORING_4SCREEN,
+} NesMirroring;
+
+/*
+ * Each slot sees the whole PRG ROM through its own ROMD region, so that
+ * writes reaching the mapper still carry the CPU address they were done
+ * at. The slot itself is an alias on the bank currently mapped.
+ */
+typedef struct NesPrgSlot {
+    NesCartridgeState *cart;
+    hwaddr base;
+    MemoryRegion view;
+    MemoryRegion window;
+} NesPrgSlot;
+
+struct NesCartridgeState {
     /*< private >*/
     DeviceState parent_obj;
 
     /*< public >*/
     char *rom_path;
+    struct ines_file *ines;
     MemoryRegion ram;
     MemoryRegion rom;
-} NesCartridgeState;
+    NesPrgSlot prg_slots[NES_PRG_NB_SLOTS];
+    uint8_t *prg_data;
+    size_t prg_size;
+
+    /* Pattern tables, for the PPU to map at 0x0000 */
+    MemoryRegion chr;
+    MemoryRegion chr_data;
+    MemoryRegion chr_slots[NES_CHR_NB_SLOTS];
+    size_t chr_size;
+    bool chr_writable;
+
+    /* Offsets of the banks mapped in the slots */
+    uint32_t prg_offsets[NES_PRG_NB_SLOTS];
+    uint32_t chr_offsets[NES_CHR_NB_SLOTS];
+
+    NesMirroring mirroring;
+    const NesMapper *mapper;
+    NesMapperState mapper_state;
+    qemu_irq irq;
+};
+
+void nes_cartridge_map_prg(NesCartridgeState *cart, hwaddr addr,
+                           uint64_t size, unsigned int bank);
+void nes_cartridge_map_chr(NesCartridgeState *cart, hwaddr addr,
+                           uint64_t size, unsigned int bank);
+unsigned int nes_cartridge_prg_banks(NesCartridgeState *cart, uint64_t size);
+uint8_t *nes_cartridge_chr_ptr(NesCartridgeState *cart, hwaddr addr);
+void nes_cartridge_set_mirroring(NesCartridgeState *cart,
+                                 NesMirroring mirroring);
+void nes_cartridge_scanline(NesCartridgeState *cart);
 
 #endif // NES_CARTRIDGE_H
@@ -0,0 +1,69 @@
+/*
+ * Nintendo Nes cartridge mappers
+ *
+ * Copyright (c) 2020 Alexandre Guyon
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NES_MAPPER_H
+#define NES_MAPPER_H
+
+typedef struct NesCartridgeState NesCartridgeState;
+
+/* Registers of the mapper chips, only the one of the cartridge is used */
+typedef union NesMapperState {
+    struct {
+        uint8_t shift;
+        uint8_t count;
+        uint8_t control;
+        uint8_t chr0;
+        uint8_t chr1;
+        uint8_t prg;
+    } mmc1;
+    struct {
+        uint8_t bank_select;
+        uint8_t regs[8];
+        uint8_t irq_latch;
+        uint8_t irq_counter;
+        bool irq_reload;
+        bool irq_enabled;
+    } mmc3;
+} NesMapperState;
+
+/**
+ * NesMapper:
+ * @id: iNES mapper number
+ * @name: board name
+ * @reset: map the power-on banks
+ * @write: CPU write to 0x8000-0xFFFF, %NULL if the registers are not wired
+ * @scanline: rising edge of PPU A12 once per rendered scanline, may be %NULL
+ *
+ * Banks are switched with nes_cartridge_map_prg() and nes_cartridge_map_chr(),
+ * the caller holds a memory transaction for @reset and @write.
+ */
+typedef struct NesMapper {
+    uint8_t id;
+    const char *name;
+    void (*reset)(NesCartridgeState *cart);
+    void (*write)(NesCartridgeState *cart, uint16_t addr, uint8_t val);
+    void (*scanline)(NesCartridgeState *cart);
+} NesMapper;
+
+const NesMapper *nes_mapper_find(uint8_t id);
+
+/* Registers of the mappers which have some, subsections of the cartridge */
+extern const VMStateDescription vmstate_nes_mapper_mmc1;
+extern const VMStateDescription vmstate_nes_mapper_mmc3;
+
+#endif // NES_MAPPER_H
@@ -0,0 +1,72 @@
+/*
+ * Nintendo Nes standard controllers
+ *
+ * Copyright (c) 2020 Alexandre Guyon
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NES_PAD_H
+#define NES_PAD_H
+
+#include "hw/qdev-core.h"
+#include "exec/memory.h"
+#include "ui/input.h"
+#include "hw/mcs6500/nes-ppu.h"
+
+#define TYPE_NES_PAD "nes-pad"
+#define NES_PAD(obj) OBJECT_CHECK(NesPadState, (obj), TYPE_NES_PAD)
+
+/* 0x4016 and 0x4017, over the APU registers */
+#define NES_PAD_REGS_SIZE 2
+#define NES_NB_PADS 2
+
+/* Buttons, in the order the shift registers return them */
+#define NES_PAD_A      (1 << 0)
+#define NES_PAD_B      (1 << 1)
+#define NES_PAD_SELECT (1 << 2)
+#define NES_PAD_START  (1 << 3)
+#define NES_PAD_UP     (1 << 4)
+#define NES_PAD_DOWN   (1 << 5)
+#define NES_PAD_LEFT   (1 << 6)
+#define NES_PAD_RIGHT  (1 << 7)
+
+typedef struct {
+    /*< private >*/
+    DeviceState parent_obj;
+
+    /*< public >*/
+    MemoryRegion regs;
+    MemoryRegion *apu;  /* Gets the writes to 0x4017, the frame counter */
+    NesPPUState *ppu;   /* Counts the frames of movies */
+    QemuInputHandlerState *input;
+
+    /*
+     * Movie: a byte per controller and per frame, mapped from the file
+     * given with the "movie" property.
+     */
+    char *movie_path;
+    GMappedFile *movie;
+    const uint8_t *movie_data;
+    uint64_t movie_frames;
+
+    /* Buttons held on the host keyboard, for the first controller */
+    uint8_t buttons;
+
+    /* The state saved in snapshots starts here */
+    uint8_t shift[NES_NB_PADS];
+    bool strobe;
+    uint64_t movie_start; /* PPU frame of the first movie frame */
+} NesPadState;
+
+#endif // NES_PAD_H
@@ -0,0 +1,88 @@
+/*
+ * Nintendo Nes 2C02 PPU
+ *
+ * Copyright (c) 2020 Alexandre Guyon
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NES_PPU_H
+#define NES_PPU_H
+
+#include "hw/qdev-core.h"
+#include "hw/irq.h"
+#include "exec/memory.h"
+#include "qemu/timer.h"
+#include "ui/console.h"
+#include "hw/mcs6500/nes-cartridge.h"
+
+#define TYPE_NES_PPU "nes-ppu"
+#define NES_PPU(obj) OBJECT_CHECK(NesPPUState, (obj), TYPE_NES_PPU)
+
+#define NES_PPU_WIDTH 256
+#define NES_PPU_HEIGHT 240
+
+/* NTSC timings, in PPU dots: 3 per CPU cycle */
+#define NES_PPU_FREQ 5369318 /* 21.477272 MHz / 4 */
+#define NES_PPU_DOTS_PER_LINE 341
+#define NES_PPU_LINES 262
+#define NES_PPU_FRAME_DOTS (NES_PPU_DOTS_PER_LINE * NES_PPU_LINES)
+#define NES_PPU_VBLANK_LINE 241
+#define NES_PPU_PRERENDER_LINE 261
+
+#define NES_PPU_VRAM_SIZE 0x1000 /* 2 KiB on the board, 4 KiB for 4-screen */
+#define NES_PPU_OAM_SIZE 0x100
+#define NES_PPU_PALETTE_SIZE 0x20
+
+typedef struct {
+    /*< private >*/
+    DeviceState parent_obj;
+
+    /*< public >*/
+    NesCartridgeState *cart;
+    MemoryRegion regs;
+    MemoryRegion dma;
+    QemuConsole *con;
+    QEMUTimer *timer;
+    qemu_irq nmi;
+
+    /* Registers, the state saved in snapshots starts here */
+    uint8_t ctrl;
+    uint8_t mask;
+    uint8_t status;
+    uint8_t oam_addr;
+    uint8_t latch;
+    uint8_t read_buffer;
+    uint16_t v;
+    uint16_t t;
+    uint8_t x;
+    bool w;
+
+    uint8_t vram[NES_PPU_VRAM_SIZE];
+    uint8_t oam[NES_PPU_OAM_SIZE];
+    uint8_t palette[NES_PPU_PALETTE_SIZE];
+
+    /*
+     * Catch-up state: the frame started at @frame_start on the virtual
+     * clock and lines before @line have been processed.
+     */
+    int64_t frame_start;
+    int line;
+    /* Frame relative dot at which sprite 0 hits, INT_MAX if it doesn't */
+    int sprite0_dot;
+    /* The guest polls for the hit, see nes_ppu_read() */
+    bool sprite0_poll;
+    uint64_t frame_count;
+} NesPPUState;
+
+#endif // NES_PPU_H
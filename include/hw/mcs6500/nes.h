@@ -49,6 +49,17 @@ static inline int nes_get_base_ram_mirror(int i)
     }
 }
 
+/* PPU registers, mirrored every 8 bytes */
+#define NES_PPU_BASE 0x2000
+#define NES_OAM_DMA_ADDR 0x4014
+#define NES_APU_BASE 0x4000
+#define NES_PAD_ADDR 0x4016
+
+/* Inputs of the IRQ line */
+#define NES_IRQ_MAPPER 0
+#define NES_IRQ_APU 1
+#define NES_NB_IRQS 2
+
 #define NES_CARTRIDGE_BASE 0x4020
 #define NES_CARTRIDGE_SIZE 0xBFE0 /* Till the end of the memory map (0xFFFF) */
 
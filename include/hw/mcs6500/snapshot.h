@@ -0,0 +1,42 @@
+/*
+ * In-memory snapshots of mcs6500 machines
+ *
+ * Copyright (c) 2020 Alexandre Guyon
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MCS6500_SNAPSHOT_H
+#define MCS6500_SNAPSHOT_H
+
+#include "exec/memory.h"
+
+typedef struct MCS6500Snapshot MCS6500Snapshot;
+
+/*
+ * Called once the areas are restored, for @opaque to rebuild what is derived
+ * from them. The virtual clock ran for @delta ns since the snapshot was
+ * taken, timestamps on that clock are to be moved by as much.
+ */
+typedef void MCS6500SnapshotRestore(void *opaque, int64_t delta);
+
+void mcs6500_snapshot_add(void *base, size_t size);
+void mcs6500_snapshot_add_ram(MemoryRegion *mr);
+void mcs6500_snapshot_add_restore(MCS6500SnapshotRestore *fn, void *opaque);
+
+MCS6500Snapshot *mcs6500_snapshot_new(void);
+void mcs6500_snapshot_free(MCS6500Snapshot *snap);
+void mcs6500_snapshot_save(MCS6500Snapshot *snap);
+void mcs6500_snapshot_load(MCS6500Snapshot *snap);
+
+#endif // MCS6500_SNAPSHOT_H
@@ -3,6 +3,17 @@
 
 #define INES_SECTION_PRG_RAM 0
 #define INES_SECTION_PRG_ROM 1
+#define INES_SECTION_CHR_ROM 2
+
+#define INES_MAPPER_NROM  0
+#define INES_MAPPER_MMC1  1
+#define INES_MAPPER_UXROM 2
+#define INES_MAPPER_CNROM 3
+#define INES_MAPPER_MMC3  4
+
+#define INES_MIRRORING_HORIZONTAL 0
+#define INES_MIRRORING_VERTICAL   1
+#define INES_MIRRORING_4SCREEN    2
 
 struct ines_mapper_section {
     uint8_t section_id;
@@ -10,12 +21,26 @@ struct ines_mapper_section {
     uint16_t end;
 };
 
-int ines_load_file(const char *path);
-int ines_is_supported(void);
-void ines_close_file(void);
+/* Loaded image, returned by ines_load_file() */
+struct ines_file;
+
+/*
+ * The image is mapped read-only: sections returned by
+ * ines_get_section_by_id() must not be written to, and stay valid until the
+ * last ines_close_file() of the image. Loading the same file again returns
+ * the same image.
+ */
+int ines_load_file(const char *path, struct ines_file **ines);
+int ines_is_supported(const struct ines_file *ines);
+void ines_close_file(struct ines_file *ines);
+
+int ines_get_sections(const struct ines_file *ines,
+                      const struct ines_mapper_section **sections);
 
-int ines_get_sections(const struct ines_mapper_section **sections);
+int ines_get_section_by_id(const struct ines_file *ines, uint8_t id,
+                           void **rom, size_t *size);
 
-int ines_get_section_by_id(uint8_t id, void **rom, size_t *size);
+int ines_get_mapper_id(const struct ines_file *ines);
+int ines_get_mirroring(const struct ines_file *ines);
 
 #endif // INES_H
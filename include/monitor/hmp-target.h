@@ -50,5 +50,9 @@ void hmp_mce(Monitor *mon, const QDict *qdict);
 void hmp_info_local_apic(Monitor *mon, const QDict *qdict);
 void hmp_info_sev(Monitor *mon, const QDict *qdict);
 void hmp_info_sgx(Monitor *mon, const QDict *qdict);
+void hmp_itrace_dump(Monitor *mon, const QDict *qdict);
+void hmp_mcs6500_snapshot_save(Monitor *mon, const QDict *qdict);
+void hmp_mcs6500_snapshot_load(Monitor *mon, const QDict *qdict);
+void hmp_info_tb_profile(Monitor *mon, const QDict *qdict);
 
 #endif /* MONITOR_HMP_TARGET_H */
@@ -20,17 +20,129 @@
 
 #include "qemu/osdep.h"
 #include "qapi/error.h"
+#include "qemu/qemu-print.h"
+#include "qemu/timer.h"
 #include "cpu.h"
+#include "disas/dis-asm.h"
+#include "exec/exec-all.h"
+#include "hw/core/sysemu-cpu-ops.h"
 #include "hw/core/tcg-cpu-ops.h"
-#include "helper.h"
+#include "hw/qdev-properties.h"
 
 static bool mcs6500_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
                        MMUAccessType qemu_access_type, int mmu_idx,
                        bool probe, uintptr_t retaddr)
 {
+    MCS6500CPU *cpu = MCS6500_CPU(cs);
+    CPUMCS6500State *env = &cpu->env;
+    int prot = PAGE_READ | PAGE_WRITE | PAGE_EXEC;
+
+    /* No MMU: the 16 bits address space is mapped 1:1 */
+    address &= TARGET_PAGE_MASK;
+
+    if (env->zp_ram && address < ZP_RAM_SIZE) {
+        if (qemu_access_type == MMU_INST_FETCH) {
+            /*
+             * Direct accesses to pages 0 and 1 don't go through the softmmu
+             * and would not invalidate code translated from there, stop
+             * using them once the guest runs code from those pages.
+             */
+            env->zp_ram = NULL;
+            tb_flush(cs);
+        } else {
+            /* Catch the first instruction fetch */
+            prot &= ~PAGE_EXEC;
+        }
+    }
+
+    tlb_set_page(cs, address, address, prot, mmu_idx, TARGET_PAGE_SIZE);
+
     return true;
 }
 
+/*
+ * Let the translator access pages 0 and 1 (zero page and stack) through
+ * @host instead of the softmmu. This must only be used when those pages are
+ * plain RAM with no side effect, note that such writes are not tracked by the
+ * dirty memory log.
+ */
+void mcs6500_cpu_set_zp_ram(MCS6500CPU *cpu, void *host)
+{
+    cpu->env.zp_ram = host;
+    tlb_flush(CPU(cpu));
+    tb_flush(CPU(cpu));
+}
+
+static void mcs6500_cpu_set_pc(CPUState *cs, vaddr value)
+{
+    MCS6500CPU *cpu = MCS6500_CPU(cs);
+
+    cpu->env.pc = value & PC_MASK;
+}
+
+static bool mcs6500_cpu_has_work(CPUState *cs)
+{
+    MCS6500CPU *cpu = MCS6500_CPU(cs);
+
+    if (cpu->env.batch_done || cpu->env.stopped) {
+        return false;
+    }
+
+    if (cs->interrupt_request & (CPU_INTERRUPT_NMI |
+                                 CPU_INTERRUPT_RESET_VECTOR |
+                                 CPU_INTERRUPT_IDLE_WAKE)) {
+        return true;
+    }
+
+    /*
+     * WAI wakes up on IRQ even when I is set. An idle loop would only spin
+     * again, the IRQ line of a device stays asserted until it is acknowledged.
+     */
+    return (cs->interrupt_request & CPU_INTERRUPT_HARD) &&
+           (!cpu->env.idle || !(cpu->env.sr & (1 << SR_I)));
+}
+
+static void mcs6500_cpu_dump_state(CPUState *cs, FILE *f, int flags)
+{
+    MCS6500CPU *cpu = MCS6500_CPU(cs);
+    CPUMCS6500State *env = &cpu->env;
+
+    uint8_t sr = cpu_get_sr(env);
+
+    qemu_fprintf(f, "PC=%04x A=%02x X=%02x Y=%02x SP=%02x "
+                 "SR=%02x [%c%c-%c%c%c%c%c]\n",
+                 env->pc, env->acc, env->x, env->y, env->sp, sr,
+                 sr & (1 << SR_N) ? 'N' : '-',
+                 sr & (1 << SR_V) ? 'V' : '-',
+                 sr & (1 << SR_B) ? 'B' : '-',
+                 sr & (1 << SR_D) ? 'D' : '-',
+                 sr & (1 << SR_I) ? 'I' : '-',
+                 sr & (1 << SR_Z) ? 'Z' : '-',
+                 sr & (1 << SR_C) ? 'C' : '-');
+    qemu_fprintf(f, "CYC=%" PRIu64 "\n", env->cycles);
+}
+
+static void mcs6500_cpu_disas_set_info(CPUState *cs, disassemble_info *info)
+{
+    CPUMCS6500State *env = &MCS6500_CPU(cs)->env;
+
+    info->arch = bfd_arch_mcs6500;
+    info->mach = 0;
+    if (mcs6500_feature(env, MCS6500_FEATURE_UNDOC)) {
+        info->mach |= bfd_mach_mcs6500_undoc;
+    }
+    if (mcs6500_feature(env, MCS6500_FEATURE_CMOS)) {
+        info->mach |= bfd_mach_mcs6500_cmos;
+    }
+    if (mcs6500_feature(env, MCS6500_FEATURE_BIT_OPS)) {
+        info->mach |= bfd_mach_mcs6500_bit_ops;
+    }
+    if (mcs6500_feature(env, MCS6500_FEATURE_WAIT_STOP)) {
+        info->mach |= bfd_mach_mcs6500_wait_stop;
+    }
+    info->print_insn = print_insn_mcs6500;
+}
+
 static void mcs6500_cpu_reset(DeviceState *dev)
 {
     CPUState *s = CPU(dev);
@@ -40,10 +152,45 @@ static void mcs6500_cpu_reset(DeviceState *dev)
 
     mcc->parent_reset(dev);
 
-    memset(env, 0, sizeof(CPUMCS6500State));
+    memset(env, 0, offsetof(CPUMCS6500State, end_reset_fields));
+
+    /*
+     * The ROM holding the vector may not be mapped yet, fetch it from
+     * mcs6500_cpu_do_interrupt() when the CPU starts running. The vCPU
+     * thread may not exist either, so don't kick it.
+     */
+    s->interrupt_request |= CPU_INTERRUPT_RESET_VECTOR;
+}
+
+static void mcs6500_cpu_set_irq(void *opaque, int irq, int level)
+{
+    MCS6500CPU *cpu = opaque;
+    CPUMCS6500State *env = &cpu->env;
+    CPUState *cs = CPU(cpu);
 
-    /* TODO: We should set PC from the interrupt vector.  */
-    env->pc = 0xFFFF;
+    switch (irq) {
+    case MCS6500_CPU_IRQ:
+        if (level) {
+            cpu_interrupt(cs, CPU_INTERRUPT_HARD);
+        } else {
+            cpu_reset_interrupt(cs, CPU_INTERRUPT_HARD);
+        }
+        break;
+    case MCS6500_CPU_NMI:
+        if (level && !env->nmi_level) {
+            cpu_interrupt(cs, CPU_INTERRUPT_NMI);
+        }
+        env->nmi_level = level;
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+/* The next device event is due, the idle loop may exit now */
+static void mcs6500_cpu_idle_timer(void *opaque)
+{
+    cpu_interrupt(CPU(opaque), CPU_INTERRUPT_IDLE_WAKE);
 }
 
 static void mcs6500_cpu_realizefn(DeviceState *dev, Error **errp)
@@ -59,6 +206,15 @@ static void mcs6500_cpu_realizefn(DeviceState *dev, Error **errp)
         return;
     }
 
+    cpu->idle_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, mcs6500_cpu_idle_timer,
+                                   cpu);
+    if (cpu->itrace_size) {
+        cpu->env.itrace = mcs6500_itrace_new(cpu->itrace_size);
+    }
+    if (cpu->tb_profile) {
+        cpu->env.tb_profile = mcs6500_tb_profile_new();
+    }
+
     cpu_reset(cs);
     qemu_init_vcpu(cs);
 
@@ -70,8 +226,52 @@ static void mcs6500_cpu_initfn(Object *obj)
     MCS6500CPU *cpu = MCS6500_CPU(obj);
 
     cpu_set_cpustate_pointers(cpu);
+
+    qdev_init_gpio_in(DEVICE(cpu), mcs6500_cpu_set_irq, 2);
+}
+
+static ObjectClass *mcs6500_cpu_class_by_name(const char *cpu_model)
+{
+    g_autofree char *typename = g_strdup_printf(MCS6500_CPU_TYPE_NAME("%s"),
+                                                cpu_model);
+    ObjectClass *oc = object_class_by_name(typename);
+
+    if (object_class_dynamic_cast(oc, TYPE_MCS6500_CPU) == NULL ||
+        object_class_is_abstract(oc)) {
+        return NULL;
+    }
+    return oc;
+}
+
+static void mcs6500_cpu_list_entry(gpointer data, gpointer user_data)
+{
+    const char *typename = object_class_get_name(OBJECT_CLASS(data));
+    int len = strlen(typename) - strlen(MCS6500_CPU_TYPE_SUFFIX);
+
+    qemu_printf("  %.*s\n", len, typename);
+}
+
+void mcs6500_cpu_list(void)
+{
+    GSList *list = object_class_get_list_sorted(TYPE_MCS6500_CPU, false);
+
+    qemu_printf("Available CPUs:\n");
+    g_slist_foreach(list, mcs6500_cpu_list_entry, NULL);
+    g_slist_free(list);
 }
 
+static Property mcs6500_cpu_properties[] = {
+    DEFINE_PROP_UINT64("max-cycles", MCS6500CPU, env.cycle_limit, 0),
+    DEFINE_PROP_INT32("trap-pc", MCS6500CPU, env.trap_pc, -1),
+    DEFINE_PROP_UINT32("itrace-size", MCS6500CPU, itrace_size, 0),
+    DEFINE_PROP_BOOL("tb-profile", MCS6500CPU, tb_profile, false),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static const struct SysemuCPUOps mcs6500_sysemu_ops = {
+    .get_phys_page_debug = mcs6500_cpu_get_phys_page_debug,
+};
+
 static const struct TCGCPUOps mcs6500_tcg_ops = {
     .initialize = mcs6500_cpu_tcg_init,
     .synchronize_from_tb = mcs6500_cpu_synchronize_from_tb,
@@ -89,10 +289,76 @@ static void mcs6500_cpu_class_init(ObjectClass *c, void *data)
     device_class_set_parent_realize(dc, mcs6500_cpu_realizefn,
                                     &mcc->parent_realize);
     device_class_set_parent_reset(dc, mcs6500_cpu_reset, &mcc->parent_reset);
+    device_class_set_props(dc, mcs6500_cpu_properties);
+    dc->vmsd = &vmstate_mcs6500_cpu;
 
+    cc->class_by_name = mcs6500_cpu_class_by_name;
+    cc->has_work = mcs6500_cpu_has_work;
+    cc->dump_state = mcs6500_cpu_dump_state;
+    cc->set_pc = mcs6500_cpu_set_pc;
+    cc->disas_set_info = mcs6500_cpu_disas_set_info;
+    cc->gdb_read_register = mcs6500_cpu_gdb_read_register;
+    cc->gdb_write_register = mcs6500_cpu_gdb_write_register;
+    cc->gdb_adjust_breakpoint = mcs6500_cpu_gdb_adjust_breakpoint;
+    cc->gdb_num_core_regs = 6;
+    cc->gdb_core_xml_file = "mcs6500-core.xml";
+    cc->sysemu_ops = &mcs6500_sysemu_ops;
     cc->tcg_ops = &mcs6500_tcg_ops;
 }
 
+static void set_feature(CPUMCS6500State *env, int feature)
+{
+    env->features |= 1U << feature;
+}
+
+/* NMOS 6502, with the stable undocumented opcodes */
+static void mcs6502_initfn(Object *obj)
+{
+    CPUMCS6500State *env = &MCS6500_CPU(obj)->env;
+
+    set_feature(env, MCS6500_FEATURE_DECIMAL);
+    set_feature(env, MCS6500_FEATURE_UNDOC);
+}
+
+/* Ricoh 2A03 of the Nes: a 6502 with decimal mode cut off */
+static void rp2a03_initfn(Object *obj)
+{
+    CPUMCS6500State *env = &MCS6500_CPU(obj)->env;
+
+    set_feature(env, MCS6500_FEATURE_UNDOC);
+}
+
+static void cmos65c02_initfn(Object *obj)
+{
+    CPUMCS6500State *env = &MCS6500_CPU(obj)->env;
+
+    set_feature(env, MCS6500_FEATURE_DECIMAL);
+    set_feature(env, MCS6500_FEATURE_CMOS);
+}
+
+static void r65c02_initfn(Object *obj)
+{
+    CPUMCS6500State *env = &MCS6500_CPU(obj)->env;
+
+    cmos65c02_initfn(obj);
+    set_feature(env, MCS6500_FEATURE_BIT_OPS);
+}
+
+static void w65c02_initfn(Object *obj)
+{
+    CPUMCS6500State *env = &MCS6500_CPU(obj)->env;
+
+    r65c02_initfn(obj);
+    set_feature(env, MCS6500_FEATURE_WAIT_STOP);
+}
+
+#define DEFINE_MCS6500_CPU_TYPE(model, initfn) \
+    { \
+        .parent = TYPE_MCS6500_CPU, \
+        .instance_init = initfn, \
+        .name = MCS6500_CPU_TYPE_NAME(model), \
+    }
+
 static const TypeInfo mcs6500_cpus_type_infos[] = {
     { /* base class should be registered first */
         .name = TYPE_MCS6500_CPU,
@@ -101,7 +367,13 @@ static const TypeInfo mcs6500_cpus_type_infos[] = {
         .instance_init = mcs6500_cpu_initfn,
         .class_size = sizeof(MCS6500CPUClass),
         .class_init = mcs6500_cpu_class_init,
-    }
+        .abstract = true,
+    },
+    DEFINE_MCS6500_CPU_TYPE("6502", mcs6502_initfn),
+    DEFINE_MCS6500_CPU_TYPE("2a03", rp2a03_initfn),
+    DEFINE_MCS6500_CPU_TYPE("65c02", cmos65c02_initfn),
+    DEFINE_MCS6500_CPU_TYPE("r65c02", r65c02_initfn),
+    DEFINE_MCS6500_CPU_TYPE("w65c02", w65c02_initfn),
 };
 
 DEFINE_TYPES(mcs6500_cpus_type_infos)
@@ -23,9 +23,48 @@
 #include "hw/core/cpu.h"
 #include "exec/cpu-defs.h"
 
+/*
+ * 6502 programs commonly patch the operand of an instruction a few bytes
+ * ahead of the one doing the store: stop the current TB when that happens.
+ */
+#define TARGET_HAS_PRECISE_SMC
+
+/*
+ * Pages are 256 bytes, so the per-byte bitmap of a code page is cheap: build
+ * it on the first write to that page. Stores to data living next to code
+ * then no longer throw the code away.
+ */
+#define SMC_BITMAP_USE_THRESHOLD 1
+
+/*
+ * A 6502 is alone on its bus: the only CPUs sharing a machine are the
+ * independent instances of the minimal board, which share no memory.
+ */
+#define TCG_GUEST_DEFAULT_MO 0
+
+/* Cycles elapsed in the TB before each instruction, see restore_state_to_opc */
+#define TARGET_INSN_START_EXTRA_WORDS 1
+
 #define TYPE_MCS6500_CPU "6500"
 #define CPU_RESOLVING_TYPE TYPE_MCS6500_CPU
 
+/* Models are selected with -cpu <model>, see mcs6500_cpu_list() */
+#define MCS6500_CPU_TYPE_SUFFIX "-mcs6500-cpu"
+#define MCS6500_CPU_TYPE_NAME(model) model MCS6500_CPU_TYPE_SUFFIX
+
+/*
+ * Features of a CPU model. They are part of the TB flags and the translator
+ * only looks at them when translating, see the opcode tables in translate.c.
+ */
+enum MCS6500Feature {
+    MCS6500_FEATURE_DECIMAL,   /* D selects BCD arithmetic, not on a 2A03 */
+    MCS6500_FEATURE_UNDOC,     /* NMOS undocumented opcodes */
+    MCS6500_FEATURE_CMOS,      /* 65C02 instructions, fixes and timings */
+    MCS6500_FEATURE_BIT_OPS,   /* Rockwell RMB, SMB, BBR and BBS */
+    MCS6500_FEATURE_WAIT_STOP, /* WDC WAI and STP */
+    MCS6500_FEATURE_COUNT,
+};
+
 #define SR_C 0 /* Carry */
 #define SR_Z 1 /* Zero result */
 #define SR_I 2 /* Interrupt disable */
@@ -37,16 +76,126 @@
 
 #define PC_MASK 0xFFFF
 
+/* The stack lives in page 1, sp is the offset within that page */
+#define STACK_BASE 0x0100
+
+/* Interrupt vectors */
+#define VECTOR_NMI 0xFFFA
+#define VECTOR_RESET 0xFFFC
+#define VECTOR_IRQ 0xFFFE
+
+/* Interrupt lines, see mcs6500_cpu_set_irq() */
+#define MCS6500_CPU_IRQ 0 /* Level triggered, masked by I */
+#define MCS6500_CPU_NMI 1 /* Falling edge on the chip, asserted as level 1 */
+
+#define CPU_INTERRUPT_NMI CPU_INTERRUPT_TGT_EXT_3
+/* Pending reset sequence: the vector is fetched once the machine is set up */
+#define CPU_INTERRUPT_RESET_VECTOR CPU_INTERRUPT_TGT_INT_0
+/* Wakes up a CPU parked in an idle loop, see helper_idle() */
+#define CPU_INTERRUPT_IDLE_WAKE CPU_INTERRUPT_TGT_INT_1
+
+/* Exceptions, as found in CPUState.exception_index */
+enum {
+    EXCP_RESET_VECTOR,
+    EXCP_NMI,
+    EXCP_IRQ,
+};
+
+/* Cycles taken by the interrupt sequence, as BRK does */
+#define INTERRUPT_CYCLES 7
+
+/* Zero page and stack */
+#define ZP_RAM_SIZE 0x0200
+
+/* Flags held in CPUMCS6500State.sr, the others are computed lazily */
+#define SR_STORED_MASK ((1 << SR_I) | (1 << SR_D))
+
+/*
+ * Registers are held in 32 bits fields so that the translator can map them
+ * on TCG globals, only the low bits are meaningful.
+ *
+ * N, V, Z and C are not packed in sr but kept in the form the last
+ * instruction produced them, use cpu_get_sr() to get the status register.
+ */
+typedef struct MCS6500ITrace MCS6500ITrace;
+typedef struct MCS6500TBProfile MCS6500TBProfile;
+
 typedef struct CPUMCS6500State CPUMCS6500State;
 struct CPUMCS6500State {
-    uint16_t pc;
-    uint8_t sr;
-    uint8_t sp;
-    uint8_t x;
-    uint8_t y;
-    uint8_t acc;
+    uint32_t pc;  /* 0x0000ffff 16 bits */
+    uint32_t sr;  /* 0x0000000c I and D only */
+    uint32_t sp;  /* 0x000000ff 8 bits */
+    uint32_t x;   /* 0x000000ff 8 bits */
+    uint32_t y;   /* 0x000000ff 8 bits */
+    uint32_t acc; /* 0x000000ff 8 bits */
+
+    uint32_t cc_n; /* 0x00000080 N is bit 7 of the last result */
+    uint32_t cc_z; /* 0x000000ff Z is set when the last result is 0 */
+    uint32_t cc_c; /* 0x00000001 C */
+    uint32_t cc_v; /* 0x00000080 V is bit 7 */
+
+    /* Stopped by STP, only a reset restarts the CPU */
+    bool stopped;
+    /* Halted by an idle loop rather than by WAI, see helper_idle() */
+    bool idle;
+
+    /* Fields up to this point are cleared by a CPU reset */
+    struct {} end_reset_fields;
+
+    /*
+     * Elapsed CPU cycles, updated when leaving a TB and not reset so that
+     * devices can use it as a monotonic time base.
+     */
+    uint64_t cycles;
+
+    /* Level of the NMI input, only a rising edge raises CPU_INTERRUPT_NMI */
+    bool nmi_level;
+
+    /*
+     * Host RAM backing pages 0 and 1 when the board declares them as plain
+     * RAM, see mcs6500_cpu_set_zp_ram().
+     */
+    uint8_t *zp_ram;
+
+    /* Batch runs: stop once cycles reaches cycle_limit or pc reaches trap_pc */
+    uint64_t cycle_limit; /* 0 for none */
+    int32_t trap_pc;      /* -1 for none */
+    bool batch_done;      /* One of them was reached */
+
+    /* Set of MCS6500Feature, from the model */
+    uint32_t features;
+
+    /* Instruction trace ring, NULL when not tracing, see itrace.c */
+    MCS6500ITrace *itrace;
+
+    /* MCS6500TBProfile by pc and flags, NULL when not profiling */
+    GHashTable *tb_profile;
 };
 
+static inline bool mcs6500_feature(CPUMCS6500State *env, int feature)
+{
+    return env->features & (1U << feature);
+}
+
+static inline uint8_t cpu_get_sr(CPUMCS6500State *env)
+{
+    return (env->sr & SR_STORED_MASK)
+        | (env->cc_n & 0x80)
+        | (env->cc_v & 0x80) >> (SR_N - SR_V)
+        | (env->cc_z == 0) << SR_Z
+        | (env->cc_c & 1) << SR_C
+        | 1 << SR_E; /* Not wired, always reads as 1 */
+}
+
+static inline void cpu_set_sr(CPUMCS6500State *env, uint8_t sr)
+{
+    env->sr = sr & SR_STORED_MASK;
+    env->cc_n = sr & (1 << SR_N);
+    env->cc_v = (sr << (SR_N - SR_V)) & 0x80;
+    env->cc_z = (sr & (1 << SR_Z)) ^ (1 << SR_Z);
+    env->cc_c = (sr >> SR_C) & 1;
+}
+
 
 #define MCS6500_CPU_CLASS(klass) \
     OBJECT_CLASS_CHECK(MCS6500CPUClass, (klass), TYPE_MCS6500_CPU)
@@ -73,6 +222,9 @@ typedef struct MCS6500CPUClass {
 /**
  * MCS6500CPU:
  * @env: #CPUMCS6500State
+ * @idle_timer: Wakes up the CPU parked in an idle loop
+ * @itrace_size: Size of the instruction trace ring in bytes, 0 for none
+ * @tb_profile: Count the executions of each TB, see profile.c
  *
  * A MCS6500 CPU.
  */
@@ -82,6 +234,9 @@ typedef struct MCS6500CPU {
     /*< public >*/
     CPUNegativeOffsetState neg;
     CPUMCS6500State env;
+    QEMUTimer *idle_timer;
+    uint32_t itrace_size;
+    bool tb_profile;
 } MCS6500CPU;
 
 typedef CPUMCS6500State CPUArchState;
@@ -95,16 +250,56 @@ static inline int cpu_mmu_index(CPUMCS6500State *env, bool ifetch)
     return MMU_NOMMU;
 }
 
+enum {
+    TB_FLAGS_ZP_RAM = 1,      /* Access pages 0 and 1 through env->zp_ram */
+    TB_FLAGS_CYCLE_LIMIT = 2, /* Check env->cycle_limit on TB entry */
+    TB_FLAGS_DECIMAL = 4,     /* D is set and the model has decimal mode */
+};
+
+/* The model features are part of the TB flags too */
+#define TB_FLAGS_FEATURES_SHIFT 8
+
+
 static inline void cpu_get_tb_cpu_state(CPUMCS6500State *env, target_ulong *pc,
                                         target_ulong *cs_base, uint32_t *flags)
 {
     *pc = env->pc;
     *cs_base = 0;
-    *flags = 0;
+    *flags = (env->zp_ram ? TB_FLAGS_ZP_RAM : 0)
+        | (env->cycle_limit ? TB_FLAGS_CYCLE_LIMIT : 0)
+        | ((env->sr & (1 << SR_D))
+           && mcs6500_feature(env, MCS6500_FEATURE_DECIMAL) ?
+           TB_FLAGS_DECIMAL : 0)
+        | env->features << TB_FLAGS_FEATURES_SHIFT;
 }
 
 void mcs6500_cpu_tcg_init(void);
+void mcs6500_cpu_list(void);
 void mcs6500_cpu_synchronize_from_tb(CPUState *cs, const TranslationBlock *tb);
+bool mcs6500_cpu_exec_interrupt(CPUState *cs, int interrupt_request);
+void mcs6500_cpu_do_interrupt(CPUState *cs);
+hwaddr mcs6500_cpu_get_phys_page_debug(CPUState *cs, vaddr addr);
+void mcs6500_cpu_set_zp_ram(MCS6500CPU *cpu, void *host);
+int mcs6500_cpu_gdb_read_register(CPUState *cs, GByteArray *buf, int reg);
+int mcs6500_cpu_gdb_write_register(CPUState *cs, uint8_t *buf, int reg);
+vaddr mcs6500_cpu_gdb_adjust_breakpoint(CPUState *cs, vaddr addr);
+MCS6500ITrace *mcs6500_itrace_new(size_t size);
+bool mcs6500_itrace_dump(MCS6500CPU *cpu, const char *filename, Error **errp);
+GHashTable *mcs6500_tb_profile_new(void);
+MCS6500TBProfile *mcs6500_tb_profile_get(CPUMCS6500State *env,
+                                         target_ulong pc, uint32_t flags);
+void mcs6500_tb_profile_set_size(MCS6500TBProfile *p, int size, int insns);
+bool mcs6500_tb_profile_report(MCS6500CPU *cpu, GString *buf, int64_t limit,
+                               Error **errp);
+
+extern const VMStateDescription vmstate_mcs6500_cpu;
+
+static inline uint64_t mcs6500_cpu_get_cycles(MCS6500CPU *cpu)
+{
+    return cpu->env.cycles;
+}
+
+#define cpu_list mcs6500_cpu_list
 
 #include "exec/cpu-all.h"
 
@@ -0,0 +1,94 @@
+/*
+ * MCS6500 gdb server stub
+ *
+ * Copyright (c) 2020 Alexandre Guyon
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "exec/gdbstub.h"
+
+/* Register numbers, see gdb-xml/mcs6500-core.xml */
+enum {
+    GDB_REG_PC,
+    GDB_REG_A,
+    GDB_REG_X,
+    GDB_REG_Y,
+    GDB_REG_SP,
+    GDB_REG_SR,
+};
+
+int mcs6500_cpu_gdb_read_register(CPUState *cs, GByteArray *mem_buf, int n)
+{
+    CPUMCS6500State *env = &MCS6500_CPU(cs)->env;
+
+    switch (n) {
+    case GDB_REG_PC:
+        return gdb_get_reg16(mem_buf, env->pc);
+    case GDB_REG_A:
+        return gdb_get_reg8(mem_buf, env->acc);
+    case GDB_REG_X:
+        return gdb_get_reg8(mem_buf, env->x);
+    case GDB_REG_Y:
+        return gdb_get_reg8(mem_buf, env->y);
+    case GDB_REG_SP:
+        return gdb_get_reg8(mem_buf, env->sp);
+    case GDB_REG_SR:
+        return gdb_get_reg8(mem_buf, cpu_get_sr(env));
+    default:
+        return 0;
+    }
+}
+
+int mcs6500_cpu_gdb_write_register(CPUState *cs, uint8_t *mem_buf, int n)
+{
+    CPUMCS6500State *env = &MCS6500_CPU(cs)->env;
+
+    switch (n) {
+    case GDB_REG_PC:
+        env->pc = lduw_le_p(mem_buf) & PC_MASK;
+        return 2;
+    case GDB_REG_A:
+        env->acc = *mem_buf;
+        return 1;
+    case GDB_REG_X:
+        env->x = *mem_buf;
+        return 1;
+    case GDB_REG_Y:
+        env->y = *mem_buf;
+        return 1;
+    case GDB_REG_SP:
+        env->sp = *mem_buf;
+        return 1;
+    case GDB_REG_SR:
+        cpu_set_sr(env, *mem_buf);
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Called as a breakpoint is inserted or removed. Only TBs looked up from now
+ * on see the change: TBs translated before could run over the breakpoint, or
+ * chain into its page without a lookup. Flush them all, breakpoints are set
+ * seldom enough.
+ */
+vaddr mcs6500_cpu_gdb_adjust_breakpoint(CPUState *cs, vaddr addr)
+{
+    tb_flush(cs);
+    return addr;
+}
@@ -1,11 +1,204 @@
 #include "qemu/osdep.h"
-#include "helper.h"
+#include "qemu/log.h"
+#include "qemu/timer.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "exec/cpu_ldst.h"
+#include "exec/helper-proto.h"
+#include "sysemu/runstate.h"
 
+static void push(CPUMCS6500State *env, uint8_t val)
+{
+    cpu_stb_data(env, STACK_BASE | env->sp, val);
+    env->sp = (env->sp - 1) & 0xff;
+}
+
+static uint16_t read_vector(CPUMCS6500State *env, uint16_t vector)
+{
+    return cpu_ldub_data(env, vector) | cpu_ldub_data(env, vector + 1) << 8;
+}
+
+/*
+ * NMI has priority over IRQ, which is ignored while I is set. The reset
+ * sequence comes first of all, it is only pending until the first
+ * instruction after a CPU reset.
+ */
 bool mcs6500_cpu_exec_interrupt(CPUState *cs, int interrupt_request)
 {
-    return false;
+    MCS6500CPU *cpu = MCS6500_CPU(cs);
+    CPUMCS6500State *env = &cpu->env;
+
+    /* Only there to get the CPU out of helper_idle() */
+    if (interrupt_request & CPU_INTERRUPT_IDLE_WAKE) {
+        cpu_reset_interrupt(cs, CPU_INTERRUPT_IDLE_WAKE);
+    }
+
+    if (interrupt_request & CPU_INTERRUPT_RESET_VECTOR) {
+        cs->exception_index = EXCP_RESET_VECTOR;
+        cpu_reset_interrupt(cs, CPU_INTERRUPT_RESET_VECTOR);
+    } else if (interrupt_request & CPU_INTERRUPT_NMI) {
+        cs->exception_index = EXCP_NMI;
+        cpu_reset_interrupt(cs, CPU_INTERRUPT_NMI);
+    } else if ((interrupt_request & CPU_INTERRUPT_HARD)
+               && !(env->sr & (1 << SR_I))) {
+        /* Level triggered, the device acknowledges it */
+        cs->exception_index = EXCP_IRQ;
+    } else {
+        return false;
+    }
+
+    mcs6500_cpu_do_interrupt(cs);
+    return true;
 }
 
+/*
+ * Everything happens here rather than through a helper and a TB flush, so
+ * that the per frame NMI only costs leaving the current TB. BRK is handled
+ * by the translator.
+ */
 void mcs6500_cpu_do_interrupt(CPUState *cs)
 {
+    MCS6500CPU *cpu = MCS6500_CPU(cs);
+    CPUMCS6500State *env = &cpu->env;
+    uint16_t vector;
+
+    switch (cs->exception_index) {
+    case EXCP_RESET_VECTOR:
+        /* The stack is accessed as for an interrupt, but read only */
+        env->sp = (env->sp - 3) & 0xff;
+        vector = VECTOR_RESET;
+        break;
+    case EXCP_NMI:
+    case EXCP_IRQ:
+        push(env, env->pc >> 8);
+        push(env, env->pc);
+        /* B is clear when pushed by an interrupt */
+        push(env, cpu_get_sr(env) & ~(1 << SR_B));
+        vector = cs->exception_index == EXCP_NMI ? VECTOR_NMI : VECTOR_IRQ;
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    env->sr |= 1 << SR_I;
+    if (mcs6500_feature(env, MCS6500_FEATURE_CMOS)) {
+        env->sr &= ~(1 << SR_D);
+    }
+    env->pc = read_vector(env, vector);
+    env->cycles += INTERRUPT_CYCLES;
+
+    cs->exception_index = -1;
+}
+
+hwaddr mcs6500_cpu_get_phys_page_debug(CPUState *cs, vaddr addr)
+{
+    /* There is no MMU, virtual and physical addresses are the same */
+    return addr & TARGET_PAGE_MASK;
+}
+
+/*
+ * Opcodes which are not part of the documented instruction set. Most of the
+ * NMOS "illegal" opcodes have side effects we don't model, the processor is
+ * halted as it would be on a KIL/JAM opcode.
+ */
+void helper_illegal(CPUMCS6500State *env, uint32_t opcode)
+{
+    CPUState *cs = env_cpu(env);
+
+    qemu_log_mask(LOG_GUEST_ERROR, "mcs6500: illegal opcode 0x%02x at 0x%04x\n",
+                  opcode, env->pc);
+
+    env->idle = false;
+    cs->halted = 1;
+    cs->exception_index = EXCP_HLT;
+    cpu_loop_exit(cs);
+}
+
+/*
+ * End of a batch run, see the max-cycles and trap-pc properties. The machine
+ * is shut down once every CPU with a limit is done, the board reports their
+ * state from its shutdown notifier.
+ */
+void helper_batch_stop(CPUMCS6500State *env)
+{
+    CPUState *cs = env_cpu(env);
+    CPUState *other;
+    bool running = false;
+
+    qatomic_set(&env->batch_done, true);
+    cs->halted = 1;
+    cs->exception_index = EXCP_HLT;
+
+    CPU_FOREACH(other) {
+        CPUMCS6500State *other_env = &MCS6500_CPU(other)->env;
+
+        if ((other_env->cycle_limit || other_env->trap_pc >= 0)
+                && !qatomic_read(&other_env->batch_done)) {
+            running = true;
+        }
+    }
+    if (!running) {
+        qemu_system_shutdown_request(SHUTDOWN_CAUSE_GUEST_SHUTDOWN);
+    }
+
+    cpu_loop_exit(cs);
+}
+
+/*
+ * WAI: wait for an interrupt. The CPU wakes up on IRQ even when I is set,
+ * it then goes on with the next instruction, see mcs6500_cpu_has_work().
+ */
+void helper_wai(CPUMCS6500State *env)
+{
+    CPUState *cs = env_cpu(env);
+
+    env->idle = false;
+    cs->halted = 1;
+    cs->exception_index = EXCP_HLT;
+    cpu_loop_exit(cs);
+}
+
+/* STP: stop the clock until the next reset */
+void helper_stp(CPUMCS6500State *env)
+{
+    CPUState *cs = env_cpu(env);
+
+    env->stopped = true;
+    cs->halted = 1;
+    cs->exception_index = EXCP_HLT;
+    cpu_loop_exit(cs);
+}
+
+/*
+ * Taken back edge of an idle loop, see is_idle_loop() in translate.c: the
+ * loop only exits once an interrupt handler changes the variable it polls
+ * or a device its register. Rather than spinning, park the CPU until the
+ * next interrupt or the next timer event of the virtual clock, @cycles are
+ * those of the TB so far. Unlike WAI, a masked IRQ doesn't wake the CPU up:
+ * the loop couldn't exit before it is taken anyway.
+ *
+ * Batch runs with a cycle limit keep spinning, so that the count is the one
+ * of the actual CPU.
+ */
+void helper_idle(CPUMCS6500State *env, uint32_t cycles)
+{
+    CPUState *cs = env_cpu(env);
+    int64_t deadline;
+
+    if (env->cycle_limit) {
+        return;
+    }
+
+    deadline = qemu_clock_deadline_ns_all(QEMU_CLOCK_VIRTUAL,
+                                          QEMU_TIMER_ATTR_ALL);
+    if (deadline >= 0) {
+        timer_mod(env_archcpu(env)->idle_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + deadline);
+    }
+
+    env->cycles += cycles;
+    env->idle = true;
+    cs->halted = 1;
+    cs->exception_index = EXCP_HLT;
+    cpu_loop_exit(cs);
 }
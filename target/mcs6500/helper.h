@@ -1,9 +1,6 @@
-#ifndef MCS6500_HELPER_H
-#define MCS6500_HELPER_H
-
-#include "cpu.h"
-
-bool mcs6500_cpu_exec_interrupt(CPUState *cs, int interrupt_request);
-void mcs6500_cpu_do_interrupt(CPUState *cs);
-
-#endif // MCS6500_HELPER_H
+DEF_HELPER_2(illegal, noreturn, env, i32)
+DEF_HELPER_1(batch_stop, noreturn, env)
+DEF_HELPER_1(wai, noreturn, env)
+DEF_HELPER_1(stp, noreturn, env)
+DEF_HELPER_2(idle, void, env, i32)
+DEF_HELPER_FLAGS_3(itrace, TCG_CALL_NO_WG, void, env, i32, i32)
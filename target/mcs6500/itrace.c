@@ -0,0 +1,235 @@
+/*
+ * MCS6500 instruction trace ring
+ *
+ * Copyright (c) 2020 Alexandre Guyon
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "cpu.h"
+#include "exec/helper-proto.h"
+
+/*
+ * Records are delta compressed against the previous one: a header byte
+ * telling which fields follow, the pc when it is not the one after the
+ * previous instruction, the opcode, the registers which changed, then the
+ * cycles elapsed since the previous record and the instruction length as a
+ * LEB128 varint of cycles << 2 | length.
+ *
+ * The ring is made of blocks which start with a key record holding every
+ * field, the cycle count included, so that the blocks left after the ring
+ * wrapped can still be decoded. Records don't cross blocks, a zero header
+ * ends a block early.
+ */
+#define ITRACE_BLOCK_SIZE 4096
+#define ITRACE_NB_REGS 5 /* A, X, Y, SR and SP */
+#define ITRACE_RECORD_MAX (1 + 2 + 1 + ITRACE_NB_REGS + 8 + 10)
+
+enum {
+    ITRACE_PC = 1 << 0,
+    ITRACE_REGS = 1 << 1, /* One bit per register from there */
+    ITRACE_KEY = 1 << 6,  /* Absolute cycle count */
+    ITRACE_VALID = 1 << 7,
+};
+
+struct MCS6500ITrace {
+    uint8_t *buf;
+    size_t size;
+    size_t pos;
+    bool wrapped;
+
+    /* Previous record */
+    uint16_t next_pc;
+    uint8_t regs[ITRACE_NB_REGS];
+    uint64_t cycles;
+};
+
+MCS6500ITrace *mcs6500_itrace_new(size_t size)
+{
+    MCS6500ITrace *t = g_new0(MCS6500ITrace, 1);
+
+    /* The block being written doesn't count, keep at least another one */
+    t->size = MAX(ROUND_UP(size, ITRACE_BLOCK_SIZE), 2 * ITRACE_BLOCK_SIZE);
+    t->buf = g_malloc0(t->size);
+    return t;
+}
+
+static size_t itrace_encode(MCS6500ITrace *t, uint8_t *rec, bool key,
+                            uint16_t pc, uint8_t opcode, int len,
+                            const uint8_t *regs, uint64_t cycles)
+{
+    uint64_t varint;
+    size_t n = 1;
+
+    rec[0] = ITRACE_VALID;
+    if (key || pc != t->next_pc) {
+        rec[0] |= ITRACE_PC;
+        rec[n++] = pc;
+        rec[n++] = pc >> 8;
+    }
+    rec[n++] = opcode;
+    for (int i = 0; i < ITRACE_NB_REGS; ++i) {
+        if (key || regs[i] != t->regs[i]) {
+            rec[0] |= ITRACE_REGS << i;
+            rec[n++] = regs[i];
+        }
+    }
+    if (key) {
+        rec[0] |= ITRACE_KEY;
+        stq_le_p(rec + n, cycles);
+        n += 8;
+        varint = len;
+    } else {
+        varint = (cycles - t->cycles) << 2 | len;
+    }
+    while (varint >= 0x80) {
+        rec[n++] = varint | 0x80;
+        varint >>= 7;
+    }
+    rec[n++] = varint;
+    return n;
+}
+
+/*
+ * Called before each instruction when tracing, @insn packs the pc, the
+ * opcode and the length of the instruction, @cycles is the count of the TB
+ * so far.
+ */
+void HELPER(itrace)(CPUMCS6500State *env, uint32_t insn, uint32_t cycles)
+{
+    MCS6500ITrace *t = env->itrace;
+    uint16_t pc = insn;
+    uint8_t opcode = insn >> 16;
+    int len = insn >> 24;
+    uint8_t regs[ITRACE_NB_REGS] = {
+        env->acc, env->x, env->y, cpu_get_sr(env), env->sp
+    };
+    uint64_t now = env->cycles + cycles;
+    size_t offset = t->pos % ITRACE_BLOCK_SIZE;
+    uint8_t rec[ITRACE_RECORD_MAX];
+    size_t n;
+
+    n = itrace_encode(t, rec, offset == 0, pc, opcode, len, regs, now);
+    if (offset + n > ITRACE_BLOCK_SIZE) {
+        /* End the block and start the next one */
+        memset(t->buf + t->pos, 0, ITRACE_BLOCK_SIZE - offset);
+        t->pos += ITRACE_BLOCK_SIZE - offset;
+        if (t->pos == t->size) {
+            t->pos = 0;
+            t->wrapped = true;
+        }
+        n = itrace_encode(t, rec, true, pc, opcode, len, regs, now);
+    }
+
+    memcpy(t->buf + t->pos, rec, n);
+    t->pos += n;
+    if (t->pos == t->size) {
+        t->pos = 0;
+        t->wrapped = true;
+    }
+
+    t->next_pc = pc + len;
+    memcpy(t->regs, regs, sizeof(regs));
+    t->cycles = now;
+}
+
+/* Decode @len bytes of a block, which may end early */
+static void itrace_dump_block(FILE *f, const uint8_t *p, size_t len)
+{
+    const uint8_t *end = p + len;
+    uint16_t pc = 0;
+    uint8_t regs[ITRACE_NB_REGS] = { 0 };
+    uint64_t cycles = 0;
+
+    while (p < end && (*p & ITRACE_VALID)) {
+        uint8_t hdr = *p++;
+        uint8_t opcode;
+        uint64_t varint;
+        int shift;
+
+        if (hdr & ITRACE_PC) {
+            pc = lduw_le_p(p);
+            p += 2;
+        }
+        opcode = *p++;
+        for (int i = 0; i < ITRACE_NB_REGS; ++i) {
+            if (hdr & (ITRACE_REGS << i)) {
+                regs[i] = *p++;
+            }
+        }
+        if (hdr & ITRACE_KEY) {
+            cycles = ldq_le_p(p);
+            p += 8;
+        }
+        varint = 0;
+        shift = 0;
+        do {
+            varint |= (uint64_t)(*p & 0x7f) << shift;
+            shift += 7;
+        } while (*p++ & 0x80);
+        cycles += varint >> 2;
+
+        fprintf(f, "%12" PRIu64 " %04x %02x A=%02x X=%02x Y=%02x SR=%02x "
+                "SP=%02x\n", cycles, pc, opcode,
+                regs[0], regs[1], regs[2], regs[3], regs[4]);
+
+        /* Where the next record is, unless it has a pc */
+        pc += varint & 3;
+    }
+}
+
+/* Runs on the vCPU thread, between two TBs */
+static void itrace_copy(CPUState *cs, run_on_cpu_data data)
+{
+    MCS6500ITrace *t = MCS6500_CPU(cs)->env.itrace;
+    MCS6500ITrace *copy = data.host_ptr;
+
+    *copy = *t;
+    copy->buf = g_memdup(t->buf, t->size);
+}
+
+bool mcs6500_itrace_dump(MCS6500CPU *cpu, const char *filename, Error **errp)
+{
+    MCS6500ITrace copy;
+    MCS6500ITrace *t = &copy;
+    size_t first, block;
+    FILE *f;
+
+    if (!cpu->env.itrace) {
+        error_setg(errp, "CPU %d is not tracing, see its itrace-size property",
+                   CPU(cpu)->cpu_index);
+        return false;
+    }
+
+    f = fopen(filename, "w");
+    if (!f) {
+        error_setg_errno(errp, errno, "Can't open '%s'", filename);
+        return false;
+    }
+
+    run_on_cpu(CPU(cpu), itrace_copy, RUN_ON_CPU_HOST_PTR(&copy));
+
+    /* Oldest block first, the current one may be partly overwritten */
+    block = QEMU_ALIGN_DOWN(t->pos, ITRACE_BLOCK_SIZE);
+    first = t->wrapped ? (block + ITRACE_BLOCK_SIZE) % t->size : 0;
+    for (size_t b = first; b != block; b = (b + ITRACE_BLOCK_SIZE) % t->size) {
+        itrace_dump_block(f, t->buf + b, ITRACE_BLOCK_SIZE);
+    }
+    itrace_dump_block(f, t->buf + block, t->pos - block);
+
+    g_free(t->buf);
+    fclose(f);
+    return true;
+}
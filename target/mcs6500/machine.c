@@ -0,0 +1,62 @@
+/*
+ * MCS6500 CPU migration
+ *
+ * Copyright (c) 2020 Alexandre Guyon
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "cpu.h"
+#include "migration/cpu.h"
+
+/*
+ * The lazy flags are saved as they are, they are only meaningful in the
+ * form the translator keeps them in anyway. The batch limits and the model
+ * come from the command line.
+ *
+ * The common CPU state holds the pending interrupts, the reset sequence
+ * included, and whether the CPU is halted: without it, the restored CPU
+ * would run the reset sequence left pending by the reset which precedes
+ * an incoming migration.
+ */
+const VMStateDescription vmstate_mcs6500_cpu = {
+    .name = "cpu",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_CPU(),
+
+        VMSTATE_UINT32(env.pc, MCS6500CPU),
+        VMSTATE_UINT32(env.sr, MCS6500CPU),
+        VMSTATE_UINT32(env.sp, MCS6500CPU),
+        VMSTATE_UINT32(env.x, MCS6500CPU),
+        VMSTATE_UINT32(env.y, MCS6500CPU),
+        VMSTATE_UINT32(env.acc, MCS6500CPU),
+
+        VMSTATE_UINT32(env.cc_n, MCS6500CPU),
+        VMSTATE_UINT32(env.cc_z, MCS6500CPU),
+        VMSTATE_UINT32(env.cc_c, MCS6500CPU),
+        VMSTATE_UINT32(env.cc_v, MCS6500CPU),
+
+        VMSTATE_BOOL(env.stopped, MCS6500CPU),
+        VMSTATE_BOOL(env.idle, MCS6500CPU),
+        VMSTATE_UINT64(env.cycles, MCS6500CPU),
+        VMSTATE_BOOL(env.nmi_level, MCS6500CPU),
+        /* Wakes up a CPU halted in an idle loop */
+        VMSTATE_TIMER_PTR(idle_timer, MCS6500CPU),
+
+        VMSTATE_END_OF_LIST()
+    }
+};
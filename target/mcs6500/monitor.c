@@ -0,0 +1,154 @@
+/*
+ * MCS6500 monitor commands
+ *
+ * Copyright (c) 2020 Alexandre Guyon
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "cpu.h"
+#include "monitor/monitor.h"
+#include "monitor/hmp-target.h"
+#include "monitor/hmp.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-misc-target.h"
+#include "qapi/type-helpers.h"
+#include "sysemu/runstate.h"
+#include "hw/mcs6500/snapshot.h"
+
+void qmp_x_mcs6500_itrace_dump(const char *filename, bool has_cpu_index,
+                               int64_t cpu_index, Error **errp)
+{
+    CPUState *cs = qemu_get_cpu(has_cpu_index ? cpu_index : 0);
+
+    if (!cs) {
+        error_setg(errp, "No CPU %" PRId64, cpu_index);
+        return;
+    }
+    mcs6500_itrace_dump(MCS6500_CPU(cs), filename, errp);
+}
+
+void hmp_itrace_dump(Monitor *mon, const QDict *qdict)
+{
+    CPUState *cs = mon_get_cpu(mon);
+    Error *err = NULL;
+
+    if (!cs) {
+        monitor_printf(mon, "No CPU available\n");
+        return;
+    }
+    mcs6500_itrace_dump(MCS6500_CPU(cs), qdict_get_str(qdict, "filename"),
+                        &err);
+    hmp_handle_error(mon, err);
+}
+
+HumanReadableText *qmp_x_query_mcs6500_tb_profile(bool has_cpu_index,
+                                                  int64_t cpu_index,
+                                                  bool has_limit, int64_t limit,
+                                                  Error **errp)
+{
+    CPUState *cs = qemu_get_cpu(has_cpu_index ? cpu_index : 0);
+    g_autoptr(GString) buf = g_string_new("");
+
+    if (!cs) {
+        error_setg(errp, "No CPU %" PRId64, cpu_index);
+        return NULL;
+    }
+    if (!mcs6500_tb_profile_report(MCS6500_CPU(cs), buf,
+                                   has_limit ? limit : 20, errp)) {
+        return NULL;
+    }
+    return human_readable_text_from_str(buf);
+}
+
+void hmp_info_tb_profile(Monitor *mon, const QDict *qdict)
+{
+    CPUState *cs = mon_get_cpu(mon);
+    g_autoptr(GString) buf = g_string_new("");
+    Error *err = NULL;
+
+    if (!cs) {
+        monitor_printf(mon, "No CPU available\n");
+        return;
+    }
+    if (!mcs6500_tb_profile_report(MCS6500_CPU(cs), buf,
+                                   qdict_get_try_int(qdict, "limit", 20),
+                                   &err)) {
+        hmp_handle_error(mon, err);
+        return;
+    }
+    monitor_printf(mon, "%s", buf->str);
+}
+
+/* In-memory snapshots by name, see hw/mcs6500/snapshot.c */
+static GHashTable *snapshots;
+
+void qmp_x_mcs6500_snapshot_save(const char *name, Error **errp)
+{
+    bool running = runstate_is_running();
+    MCS6500Snapshot *snap;
+
+    if (!snapshots) {
+        snapshots = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                          (GDestroyNotify)
+                                          mcs6500_snapshot_free);
+    }
+
+    /* The vCPUs must not run while their state is copied */
+    vm_stop(RUN_STATE_SAVE_VM);
+    snap = mcs6500_snapshot_new();
+    mcs6500_snapshot_save(snap);
+    g_hash_table_insert(snapshots, g_strdup(name), snap);
+    if (running) {
+        vm_start();
+    }
+}
+
+void qmp_x_mcs6500_snapshot_load(const char *name, Error **errp)
+{
+    bool running = runstate_is_running();
+    MCS6500Snapshot *snap = snapshots ? g_hash_table_lookup(snapshots, name)
+                                      : NULL;
+
+    if (!snap) {
+        error_setg(errp, "No snapshot '%s'", name);
+        return;
+    }
+
+    vm_stop(RUN_STATE_RESTORE_VM);
+    mcs6500_snapshot_load(snap);
+    if (running) {
+        vm_start();
+    } else if (runstate_needs_reset()) {
+        /* Back before the end of a batch run, which may run again */
+        runstate_set(RUN_STATE_PAUSED);
+    }
+}
+
+void hmp_mcs6500_snapshot_save(Monitor *mon, const QDict *qdict)
+{
+    Error *err = NULL;
+
+    qmp_x_mcs6500_snapshot_save(qdict_get_str(qdict, "name"), &err);
+    hmp_handle_error(mon, err);
+}
+
+void hmp_mcs6500_snapshot_load(Monitor *mon, const QDict *qdict)
+{
+    Error *err = NULL;
+
+    qmp_x_mcs6500_snapshot_load(qdict_get_str(qdict, "name"), &err);
+    hmp_handle_error(mon, err);
+}
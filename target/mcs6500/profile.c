@@ -0,0 +1,189 @@
+/*
+ * MCS6500 TB execution profile
+ *
+ * Copyright (c) 2020 Alexandre Guyon
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "disas/dis-asm.h"
+
+/*
+ * TBs count their executions themselves, with a plain increment of their
+ * entry in the table of the CPU which translated them. Entries are keyed by
+ * pc and TB flags, so that the counts survive TB flushes and retranslation.
+ * A TB run by another vCPU, which only happens when instances share code,
+ * may lose a few counts in a race.
+ */
+struct MCS6500TBProfile {
+    uint64_t count; /* First, the translator increments it at the entry */
+    uint16_t pc;
+    uint32_t flags;
+    uint16_t size;  /* Guest bytes covered by the last translation */
+    uint16_t insns;
+};
+
+GHashTable *mcs6500_tb_profile_new(void)
+{
+    return g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, g_free);
+}
+
+MCS6500TBProfile *mcs6500_tb_profile_get(CPUMCS6500State *env,
+                                         target_ulong pc, uint32_t flags)
+{
+    uint64_t key = (uint64_t)flags << 16 | pc;
+    MCS6500TBProfile *p = g_hash_table_lookup(env->tb_profile, &key);
+
+    if (!p) {
+        p = g_new0(MCS6500TBProfile, 1);
+        p->pc = pc;
+        p->flags = flags;
+        g_hash_table_insert(env->tb_profile, g_memdup(&key, sizeof(key)), p);
+    }
+    return p;
+}
+
+void mcs6500_tb_profile_set_size(MCS6500TBProfile *p, int size, int insns)
+{
+    p->size = size;
+    p->insns = insns;
+}
+
+typedef struct TBProfileEntry {
+    MCS6500TBProfile prof;
+    size_t host_size; /* 0 when the TB is not in the cache anymore */
+} TBProfileEntry;
+
+/* Runs on the vCPU thread, between two TBs */
+static void tb_profile_copy(CPUState *cs, run_on_cpu_data data)
+{
+    GHashTable *table = MCS6500_CPU(cs)->env.tb_profile;
+    GArray *entries = data.host_ptr;
+    GHashTableIter iter;
+    MCS6500TBProfile *p;
+
+    g_hash_table_iter_init(&iter, table);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&p)) {
+        TBProfileEntry e = { .prof = *p };
+        TranslationBlock *tb = tb_htable_lookup(cs, p->pc, 0, p->flags,
+                                                curr_cflags(cs));
+
+        if (tb) {
+            e.host_size = tb->tc.size;
+        }
+        g_array_append_val(entries, e);
+    }
+}
+
+static gint tb_profile_cmp(gconstpointer a, gconstpointer b)
+{
+    const TBProfileEntry *ea = a, *eb = b;
+
+    return ea->prof.count < eb->prof.count ? 1 :
+           ea->prof.count > eb->prof.count ? -1 : 0;
+}
+
+static int tb_profile_printf(FILE *stream, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    g_string_append_vprintf((GString *)stream, fmt, ap);
+    va_end(ap);
+    return 0;
+}
+
+static int tb_profile_read_memory(bfd_vma addr, bfd_byte *buf, int length,
+                                  struct disassemble_info *info)
+{
+    return cpu_memory_rw_debug(info->application_data, addr, buf, length,
+                               false);
+}
+
+static void tb_profile_memory_error(int status, bfd_vma addr,
+                                    struct disassemble_info *info)
+{
+}
+
+/* The instructions of the TB, as they are in memory now */
+static void tb_profile_disas(GString *buf, CPUState *cs,
+                             const MCS6500TBProfile *p)
+{
+    disassemble_info info = {
+        .fprintf_func = tb_profile_printf,
+        .stream = (FILE *)buf,
+        .application_data = cs,
+        .read_memory_func = tb_profile_read_memory,
+        .memory_error_func = tb_profile_memory_error,
+        .endian = BFD_ENDIAN_LITTLE,
+    };
+    uint32_t end = p->pc + p->size;
+
+    CPU_GET_CLASS(cs)->disas_set_info(cs, &info);
+    for (uint32_t pc = p->pc; pc < end; ) {
+        int len;
+
+        g_string_append_printf(buf, "    %04x  ", pc & PC_MASK);
+        len = info.print_insn(pc & PC_MASK, &info);
+        g_string_append_c(buf, '\n');
+        if (len <= 0) {
+            break;
+        }
+        pc += len;
+    }
+}
+
+bool mcs6500_tb_profile_report(MCS6500CPU *cpu, GString *buf, int64_t limit,
+                               Error **errp)
+{
+    CPUState *cs = CPU(cpu);
+    g_autoptr(GArray) entries = NULL;
+    uint64_t total = 0;
+
+    if (!cpu->env.tb_profile) {
+        error_setg(errp, "CPU %d is not profiling, see its tb-profile property",
+                   cs->cpu_index);
+        return false;
+    }
+
+    entries = g_array_new(false, false, sizeof(TBProfileEntry));
+    run_on_cpu(cs, tb_profile_copy, RUN_ON_CPU_HOST_PTR(entries));
+    g_array_sort(entries, tb_profile_cmp);
+
+    for (guint i = 0; i < entries->len; ++i) {
+        total += g_array_index(entries, TBProfileEntry, i).prof.count;
+    }
+
+    g_string_append_printf(buf, "CPU %d: %u TBs, %" PRIu64 " executions\n",
+                           cs->cpu_index, entries->len, total);
+    for (guint i = 0; i < entries->len && i < limit; ++i) {
+        TBProfileEntry *e = &g_array_index(entries, TBProfileEntry, i);
+
+        g_string_append_printf(buf, "\n%04x flags=%04x count=%" PRIu64
+                               " (%.2f%%) insns=%u guest=%u host=",
+                               e->prof.pc, e->prof.flags, e->prof.count,
+                               total ? 100.0 * e->prof.count / total : 0.0,
+                               e->prof.insns, e->prof.size);
+        if (e->host_size) {
+            g_string_append_printf(buf, "%zu\n", e->host_size);
+        } else {
+            g_string_append(buf, "-\n");
+        }
+        tb_profile_disas(buf, cs, &e->prof);
+    }
+    return true;
+}
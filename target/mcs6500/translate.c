@@ -2,35 +2,2064 @@
 #include "qemu/log.h"
 #include "cpu.h"
 #include "exec/exec-all.h"
-
+#include "tcg/tcg-op.h"
+#include "exec/helper-proto.h"
+#include "exec/helper-gen.h"
+#include "exec/log.h"
 #include "exec/translator.h"
+#include "exec/gen-icount.h"
+
+static TCGv cpu_pc;
+static TCGv cpu_sr;
+static TCGv cpu_sp;
+static TCGv cpu_x;
+static TCGv cpu_y;
+static TCGv cpu_acc;
+
+static TCGv cpu_cc_n;
+static TCGv cpu_cc_z;
+static TCGv cpu_cc_c;
+static TCGv cpu_cc_v;
+
+static TCGv_ptr cpu_zp_ram;
+static TCGv_i64 cpu_cycles;
+
+/*
+ * Decimal mode results, indexed by carry << 16 | A << 8 | operand, built
+ * once by mcs6500_cpu_tcg_init(). See gen_adc_decimal() for the layout of
+ * bcd_adc, the SBC tables only hold A as the flags are the binary ones.
+ * The 65C02 adjusts the SBC result differently when an operand is not
+ * valid BCD.
+ */
+static uint32_t bcd_adc[2 << 16];
+static uint8_t bcd_sbc[2 << 16];
+static uint8_t bcd_sbc_cmos[2 << 16];
+
+#define DISAS_EXIT   DISAS_TARGET_0 /* pc updated, return to the main loop */
+#define DISAS_UPDATE DISAS_TARGET_1 /* cpu state changed, same as above */
+#define DISAS_LOOKUP DISAS_TARGET_2 /* pc updated, look the next TB up */
+
+/* Addressing modes */
+enum {
+    AM_IMP, /* Implied */
+    AM_ACC, /* Accumulator */
+    AM_IMM, /* #$nn */
+    AM_ZP,  /* $nn */
+    AM_ZPX, /* $nn,X */
+    AM_ZPY, /* $nn,Y */
+    AM_ABS, /* $nnnn */
+    AM_ABX, /* $nnnn,X */
+    AM_ABY, /* $nnnn,Y */
+    AM_IND, /* ($nnnn) */
+    AM_IZX, /* ($nn,X) */
+    AM_IZY, /* ($nn),Y */
+    AM_REL, /* Branch offset */
+    AM_IZP, /* ($nn), 65C02 */
+    AM_IAX, /* ($nnnn,X), 65C02 */
+    AM_ZPR, /* $nn,offset, BBR and BBS */
+};
+
+static const uint8_t operand_size[] = {
+    [AM_IMP] = 0, [AM_ACC] = 0,
+    [AM_IMM] = 1, [AM_ZP] = 1, [AM_ZPX] = 1, [AM_ZPY] = 1,
+    [AM_IZX] = 1, [AM_IZY] = 1, [AM_REL] = 1,
+    [AM_ABS] = 2, [AM_ABX] = 2, [AM_ABY] = 2, [AM_IND] = 2,
+    [AM_IZP] = 1, [AM_IAX] = 2, [AM_ZPR] = 2,
+};
+
+/* Instructions, INSN_ILL must stay first so undefined opcodes default to it */
+enum {
+    INSN_ILL,
+    INSN_ADC, INSN_AND, INSN_ASL, INSN_BCC, INSN_BCS, INSN_BEQ, INSN_BIT,
+    INSN_BMI, INSN_BNE, INSN_BPL, INSN_BRK, INSN_BVC, INSN_BVS, INSN_CLC,
+    INSN_CLD, INSN_CLI, INSN_CLV, INSN_CMP, INSN_CPX, INSN_CPY, INSN_DEC,
+    INSN_DEX, INSN_DEY, INSN_EOR, INSN_INC, INSN_INX, INSN_INY, INSN_JMP,
+    INSN_JSR, INSN_LDA, INSN_LDX, INSN_LDY, INSN_LSR, INSN_NOP, INSN_ORA,
+    INSN_PHA, INSN_PHP, INSN_PLA, INSN_PLP, INSN_ROL, INSN_ROR, INSN_RTI,
+    INSN_RTS, INSN_SBC, INSN_SEC, INSN_SED, INSN_SEI, INSN_STA, INSN_STX,
+    INSN_STY, INSN_TAX, INSN_TAY, INSN_TSX, INSN_TXA, INSN_TXS, INSN_TYA,
+    /* NMOS undocumented */
+    INSN_ALR, INSN_ANC, INSN_ARR, INSN_DCP, INSN_ISC, INSN_LAX, INSN_RLA,
+    INSN_RRA, INSN_SAX, INSN_SBX, INSN_SLO, INSN_SRE,
+    /* 65C02 */
+    INSN_BRA, INSN_PHX, INSN_PHY, INSN_PLX, INSN_PLY, INSN_STZ, INSN_TRB,
+    INSN_TSB,
+    /* Rockwell and WDC */
+    INSN_BBR, INSN_BBS, INSN_RMB, INSN_SMB, INSN_STP, INSN_WAI,
+};
+
+typedef struct MCS6500Opcode {
+    uint8_t insn;
+    uint8_t mode;
+    uint8_t cycles;
+} MCS6500Opcode;
+
+/* Documented NMOS 6502 instruction set and base cycle counts */
+static const MCS6500Opcode opcodes[256] = {
+    [0x00] = { INSN_BRK, AM_IMP, 7 },
+    [0x01] = { INSN_ORA, AM_IZX, 6 },
+    [0x05] = { INSN_ORA, AM_ZP, 3 },
+    [0x06] = { INSN_ASL, AM_ZP, 5 },
+    [0x08] = { INSN_PHP, AM_IMP, 3 },
+    [0x09] = { INSN_ORA, AM_IMM, 2 },
+    [0x0A] = { INSN_ASL, AM_ACC, 2 },
+    [0x0D] = { INSN_ORA, AM_ABS, 4 },
+    [0x0E] = { INSN_ASL, AM_ABS, 6 },
+    [0x10] = { INSN_BPL, AM_REL, 2 },
+    [0x11] = { INSN_ORA, AM_IZY, 5 },
+    [0x15] = { INSN_ORA, AM_ZPX, 4 },
+    [0x16] = { INSN_ASL, AM_ZPX, 6 },
+    [0x18] = { INSN_CLC, AM_IMP, 2 },
+    [0x19] = { INSN_ORA, AM_ABY, 4 },
+    [0x1D] = { INSN_ORA, AM_ABX, 4 },
+    [0x1E] = { INSN_ASL, AM_ABX, 7 },
+    [0x20] = { INSN_JSR, AM_ABS, 6 },
+    [0x21] = { INSN_AND, AM_IZX, 6 },
+    [0x24] = { INSN_BIT, AM_ZP, 3 },
+    [0x25] = { INSN_AND, AM_ZP, 3 },
+    [0x26] = { INSN_ROL, AM_ZP, 5 },
+    [0x28] = { INSN_PLP, AM_IMP, 4 },
+    [0x29] = { INSN_AND, AM_IMM, 2 },
+    [0x2A] = { INSN_ROL, AM_ACC, 2 },
+    [0x2C] = { INSN_BIT, AM_ABS, 4 },
+    [0x2D] = { INSN_AND, AM_ABS, 4 },
+    [0x2E] = { INSN_ROL, AM_ABS, 6 },
+    [0x30] = { INSN_BMI, AM_REL, 2 },
+    [0x31] = { INSN_AND, AM_IZY, 5 },
+    [0x35] = { INSN_AND, AM_ZPX, 4 },
+    [0x36] = { INSN_ROL, AM_ZPX, 6 },
+    [0x38] = { INSN_SEC, AM_IMP, 2 },
+    [0x39] = { INSN_AND, AM_ABY, 4 },
+    [0x3D] = { INSN_AND, AM_ABX, 4 },
+    [0x3E] = { INSN_ROL, AM_ABX, 7 },
+    [0x40] = { INSN_RTI, AM_IMP, 6 },
+    [0x41] = { INSN_EOR, AM_IZX, 6 },
+    [0x45] = { INSN_EOR, AM_ZP, 3 },
+    [0x46] = { INSN_LSR, AM_ZP, 5 },
+    [0x48] = { INSN_PHA, AM_IMP, 3 },
+    [0x49] = { INSN_EOR, AM_IMM, 2 },
+    [0x4A] = { INSN_LSR, AM_ACC, 2 },
+    [0x4C] = { INSN_JMP, AM_ABS, 3 },
+    [0x4D] = { INSN_EOR, AM_ABS, 4 },
+    [0x4E] = { INSN_LSR, AM_ABS, 6 },
+    [0x50] = { INSN_BVC, AM_REL, 2 },
+    [0x51] = { INSN_EOR, AM_IZY, 5 },
+    [0x55] = { INSN_EOR, AM_ZPX, 4 },
+    [0x56] = { INSN_LSR, AM_ZPX, 6 },
+    [0x58] = { INSN_CLI, AM_IMP, 2 },
+    [0x59] = { INSN_EOR, AM_ABY, 4 },
+    [0x5D] = { INSN_EOR, AM_ABX, 4 },
+    [0x5E] = { INSN_LSR, AM_ABX, 7 },
+    [0x60] = { INSN_RTS, AM_IMP, 6 },
+    [0x61] = { INSN_ADC, AM_IZX, 6 },
+    [0x65] = { INSN_ADC, AM_ZP, 3 },
+    [0x66] = { INSN_ROR, AM_ZP, 5 },
+    [0x68] = { INSN_PLA, AM_IMP, 4 },
+    [0x69] = { INSN_ADC, AM_IMM, 2 },
+    [0x6A] = { INSN_ROR, AM_ACC, 2 },
+    [0x6C] = { INSN_JMP, AM_IND, 5 },
+    [0x6D] = { INSN_ADC, AM_ABS, 4 },
+    [0x6E] = { INSN_ROR, AM_ABS, 6 },
+    [0x70] = { INSN_BVS, AM_REL, 2 },
+    [0x71] = { INSN_ADC, AM_IZY, 5 },
+    [0x75] = { INSN_ADC, AM_ZPX, 4 },
+    [0x76] = { INSN_ROR, AM_ZPX, 6 },
+    [0x78] = { INSN_SEI, AM_IMP, 2 },
+    [0x79] = { INSN_ADC, AM_ABY, 4 },
+    [0x7D] = { INSN_ADC, AM_ABX, 4 },
+    [0x7E] = { INSN_ROR, AM_ABX, 7 },
+    [0x81] = { INSN_STA, AM_IZX, 6 },
+    [0x84] = { INSN_STY, AM_ZP, 3 },
+    [0x85] = { INSN_STA, AM_ZP, 3 },
+    [0x86] = { INSN_STX, AM_ZP, 3 },
+    [0x88] = { INSN_DEY, AM_IMP, 2 },
+    [0x8A] = { INSN_TXA, AM_IMP, 2 },
+    [0x8C] = { INSN_STY, AM_ABS, 4 },
+    [0x8D] = { INSN_STA, AM_ABS, 4 },
+    [0x8E] = { INSN_STX, AM_ABS, 4 },
+    [0x90] = { INSN_BCC, AM_REL, 2 },
+    [0x91] = { INSN_STA, AM_IZY, 6 },
+    [0x94] = { INSN_STY, AM_ZPX, 4 },
+    [0x95] = { INSN_STA, AM_ZPX, 4 },
+    [0x96] = { INSN_STX, AM_ZPY, 4 },
+    [0x98] = { INSN_TYA, AM_IMP, 2 },
+    [0x99] = { INSN_STA, AM_ABY, 5 },
+    [0x9A] = { INSN_TXS, AM_IMP, 2 },
+    [0x9D] = { INSN_STA, AM_ABX, 5 },
+    [0xA0] = { INSN_LDY, AM_IMM, 2 },
+    [0xA1] = { INSN_LDA, AM_IZX, 6 },
+    [0xA2] = { INSN_LDX, AM_IMM, 2 },
+    [0xA4] = { INSN_LDY, AM_ZP, 3 },
+    [0xA5] = { INSN_LDA, AM_ZP, 3 },
+    [0xA6] = { INSN_LDX, AM_ZP, 3 },
+    [0xA8] = { INSN_TAY, AM_IMP, 2 },
+    [0xA9] = { INSN_LDA, AM_IMM, 2 },
+    [0xAA] = { INSN_TAX, AM_IMP, 2 },
+    [0xAC] = { INSN_LDY, AM_ABS, 4 },
+    [0xAD] = { INSN_LDA, AM_ABS, 4 },
+    [0xAE] = { INSN_LDX, AM_ABS, 4 },
+    [0xB0] = { INSN_BCS, AM_REL, 2 },
+    [0xB1] = { INSN_LDA, AM_IZY, 5 },
+    [0xB4] = { INSN_LDY, AM_ZPX, 4 },
+    [0xB5] = { INSN_LDA, AM_ZPX, 4 },
+    [0xB6] = { INSN_LDX, AM_ZPY, 4 },
+    [0xB8] = { INSN_CLV, AM_IMP, 2 },
+    [0xB9] = { INSN_LDA, AM_ABY, 4 },
+    [0xBA] = { INSN_TSX, AM_IMP, 2 },
+    [0xBC] = { INSN_LDY, AM_ABX, 4 },
+    [0xBD] = { INSN_LDA, AM_ABX, 4 },
+    [0xBE] = { INSN_LDX, AM_ABY, 4 },
+    [0xC0] = { INSN_CPY, AM_IMM, 2 },
+    [0xC1] = { INSN_CMP, AM_IZX, 6 },
+    [0xC4] = { INSN_CPY, AM_ZP, 3 },
+    [0xC5] = { INSN_CMP, AM_ZP, 3 },
+    [0xC6] = { INSN_DEC, AM_ZP, 5 },
+    [0xC8] = { INSN_INY, AM_IMP, 2 },
+    [0xC9] = { INSN_CMP, AM_IMM, 2 },
+    [0xCA] = { INSN_DEX, AM_IMP, 2 },
+    [0xCC] = { INSN_CPY, AM_ABS, 4 },
+    [0xCD] = { INSN_CMP, AM_ABS, 4 },
+    [0xCE] = { INSN_DEC, AM_ABS, 6 },
+    [0xD0] = { INSN_BNE, AM_REL, 2 },
+    [0xD1] = { INSN_CMP, AM_IZY, 5 },
+    [0xD5] = { INSN_CMP, AM_ZPX, 4 },
+    [0xD6] = { INSN_DEC, AM_ZPX, 6 },
+    [0xD8] = { INSN_CLD, AM_IMP, 2 },
+    [0xD9] = { INSN_CMP, AM_ABY, 4 },
+    [0xDD] = { INSN_CMP, AM_ABX, 4 },
+    [0xDE] = { INSN_DEC, AM_ABX, 7 },
+    [0xE0] = { INSN_CPX, AM_IMM, 2 },
+    [0xE1] = { INSN_SBC, AM_IZX, 6 },
+    [0xE4] = { INSN_CPX, AM_ZP, 3 },
+    [0xE5] = { INSN_SBC, AM_ZP, 3 },
+    [0xE6] = { INSN_INC, AM_ZP, 5 },
+    [0xE8] = { INSN_INX, AM_IMP, 2 },
+    [0xE9] = { INSN_SBC, AM_IMM, 2 },
+    [0xEA] = { INSN_NOP, AM_IMP, 2 },
+    [0xEC] = { INSN_CPX, AM_ABS, 4 },
+    [0xED] = { INSN_SBC, AM_ABS, 4 },
+    [0xEE] = { INSN_INC, AM_ABS, 6 },
+    [0xF0] = { INSN_BEQ, AM_REL, 2 },
+    [0xF1] = { INSN_SBC, AM_IZY, 5 },
+    [0xF5] = { INSN_SBC, AM_ZPX, 4 },
+    [0xF6] = { INSN_INC, AM_ZPX, 6 },
+    [0xF8] = { INSN_SED, AM_IMP, 2 },
+    [0xF9] = { INSN_SBC, AM_ABY, 4 },
+    [0xFD] = { INSN_SBC, AM_ABX, 4 },
+    [0xFE] = { INSN_INC, AM_ABX, 7 },
+};
+
+/*
+ * The tables below are laid over the documented set, in that order, for the
+ * features of the model. Only their non INSN_ILL entries count.
+ */
+
+/*
+ * NMOS undocumented opcodes with a stable behaviour. The unstable ones
+ * (XAA, LAS, TAS, SHA, SHX, SHY) and the JAMs stay illegal.
+ */
+static const MCS6500Opcode opcodes_undoc[256] = {
+    [0x03] = { INSN_SLO, AM_IZX, 8 },
+    [0x04] = { INSN_NOP, AM_ZP, 3 },
+    [0x07] = { INSN_SLO, AM_ZP, 5 },
+    [0x0B] = { INSN_ANC, AM_IMM, 2 },
+    [0x0C] = { INSN_NOP, AM_ABS, 4 },
+    [0x0F] = { INSN_SLO, AM_ABS, 6 },
+    [0x13] = { INSN_SLO, AM_IZY, 8 },
+    [0x14] = { INSN_NOP, AM_ZPX, 4 },
+    [0x17] = { INSN_SLO, AM_ZPX, 6 },
+    [0x1A] = { INSN_NOP, AM_IMP, 2 },
+    [0x1B] = { INSN_SLO, AM_ABY, 7 },
+    [0x1C] = { INSN_NOP, AM_ABX, 4 },
+    [0x1F] = { INSN_SLO, AM_ABX, 7 },
+    [0x23] = { INSN_RLA, AM_IZX, 8 },
+    [0x27] = { INSN_RLA, AM_ZP, 5 },
+    [0x2B] = { INSN_ANC, AM_IMM, 2 },
+    [0x2F] = { INSN_RLA, AM_ABS, 6 },
+    [0x33] = { INSN_RLA, AM_IZY, 8 },
+    [0x34] = { INSN_NOP, AM_ZPX, 4 },
+    [0x37] = { INSN_RLA, AM_ZPX, 6 },
+    [0x3A] = { INSN_NOP, AM_IMP, 2 },
+    [0x3B] = { INSN_RLA, AM_ABY, 7 },
+    [0x3C] = { INSN_NOP, AM_ABX, 4 },
+    [0x3F] = { INSN_RLA, AM_ABX, 7 },
+    [0x43] = { INSN_SRE, AM_IZX, 8 },
+    [0x44] = { INSN_NOP, AM_ZP, 3 },
+    [0x47] = { INSN_SRE, AM_ZP, 5 },
+    [0x4B] = { INSN_ALR, AM_IMM, 2 },
+    [0x4F] = { INSN_SRE, AM_ABS, 6 },
+    [0x53] = { INSN_SRE, AM_IZY, 8 },
+    [0x54] = { INSN_NOP, AM_ZPX, 4 },
+    [0x57] = { INSN_SRE, AM_ZPX, 6 },
+    [0x5A] = { INSN_NOP, AM_IMP, 2 },
+    [0x5B] = { INSN_SRE, AM_ABY, 7 },
+    [0x5C] = { INSN_NOP, AM_ABX, 4 },
+    [0x5F] = { INSN_SRE, AM_ABX, 7 },
+    [0x63] = { INSN_RRA, AM_IZX, 8 },
+    [0x64] = { INSN_NOP, AM_ZP, 3 },
+    [0x67] = { INSN_RRA, AM_ZP, 5 },
+    [0x6B] = { INSN_ARR, AM_IMM, 2 },
+    [0x6F] = { INSN_RRA, AM_ABS, 6 },
+    [0x73] = { INSN_RRA, AM_IZY, 8 },
+    [0x74] = { INSN_NOP, AM_ZPX, 4 },
+    [0x77] = { INSN_RRA, AM_ZPX, 6 },
+    [0x7A] = { INSN_NOP, AM_IMP, 2 },
+    [0x7B] = { INSN_RRA, AM_ABY, 7 },
+    [0x7C] = { INSN_NOP, AM_ABX, 4 },
+    [0x7F] = { INSN_RRA, AM_ABX, 7 },
+    [0x80] = { INSN_NOP, AM_IMM, 2 },
+    [0x82] = { INSN_NOP, AM_IMM, 2 },
+    [0x83] = { INSN_SAX, AM_IZX, 6 },
+    [0x87] = { INSN_SAX, AM_ZP, 3 },
+    [0x89] = { INSN_NOP, AM_IMM, 2 },
+    [0x8F] = { INSN_SAX, AM_ABS, 4 },
+    [0x97] = { INSN_SAX, AM_ZPY, 4 },
+    [0xA3] = { INSN_LAX, AM_IZX, 6 },
+    [0xA7] = { INSN_LAX, AM_ZP, 3 },
+    [0xAB] = { INSN_LAX, AM_IMM, 2 }, /* Actually (A | magic) & #, magic FF */
+    [0xAF] = { INSN_LAX, AM_ABS, 4 },
+    [0xB3] = { INSN_LAX, AM_IZY, 5 },
+    [0xB7] = { INSN_LAX, AM_ZPY, 4 },
+    [0xBF] = { INSN_LAX, AM_ABY, 4 },
+    [0xC2] = { INSN_NOP, AM_IMM, 2 },
+    [0xC3] = { INSN_DCP, AM_IZX, 8 },
+    [0xC7] = { INSN_DCP, AM_ZP, 5 },
+    [0xCB] = { INSN_SBX, AM_IMM, 2 },
+    [0xCF] = { INSN_DCP, AM_ABS, 6 },
+    [0xD3] = { INSN_DCP, AM_IZY, 8 },
+    [0xD4] = { INSN_NOP, AM_ZPX, 4 },
+    [0xD7] = { INSN_DCP, AM_ZPX, 6 },
+    [0xDA] = { INSN_NOP, AM_IMP, 2 },
+    [0xDB] = { INSN_DCP, AM_ABY, 7 },
+    [0xDC] = { INSN_NOP, AM_ABX, 4 },
+    [0xDF] = { INSN_DCP, AM_ABX, 7 },
+    [0xE2] = { INSN_NOP, AM_IMM, 2 },
+    [0xE3] = { INSN_ISC, AM_IZX, 8 },
+    [0xE7] = { INSN_ISC, AM_ZP, 5 },
+    [0xEB] = { INSN_SBC, AM_IMM, 2 },
+    [0xEF] = { INSN_ISC, AM_ABS, 6 },
+    [0xF3] = { INSN_ISC, AM_IZY, 8 },
+    [0xF4] = { INSN_NOP, AM_ZPX, 4 },
+    [0xF7] = { INSN_ISC, AM_ZPX, 6 },
+    [0xFA] = { INSN_NOP, AM_IMP, 2 },
+    [0xFB] = { INSN_ISC, AM_ABY, 7 },
+    [0xFC] = { INSN_NOP, AM_ABX, 4 },
+    [0xFF] = { INSN_ISC, AM_ABX, 7 },
+};
+
+/*
+ * 65C02 additions and changes. Every undefined opcode is a NOP, of one to
+ * three bytes, the one byte ones taking a single cycle.
+ */
+static const MCS6500Opcode opcodes_cmos[256] = {
+    [0x02] = { INSN_NOP, AM_IMM, 2 },
+    [0x03] = { INSN_NOP, AM_IMP, 1 },
+    [0x04] = { INSN_TSB, AM_ZP, 5 },
+    [0x07] = { INSN_NOP, AM_IMP, 1 },
+    [0x0B] = { INSN_NOP, AM_IMP, 1 },
+    [0x0C] = { INSN_TSB, AM_ABS, 6 },
+    [0x0F] = { INSN_NOP, AM_IMP, 1 },
+    [0x12] = { INSN_ORA, AM_IZP, 5 },
+    [0x13] = { INSN_NOP, AM_IMP, 1 },
+    [0x14] = { INSN_TRB, AM_ZP, 5 },
+    [0x17] = { INSN_NOP, AM_IMP, 1 },
+    [0x1A] = { INSN_INC, AM_ACC, 2 },
+    [0x1B] = { INSN_NOP, AM_IMP, 1 },
+    [0x1C] = { INSN_TRB, AM_ABS, 6 },
+    [0x1E] = { INSN_ASL, AM_ABX, 6 },
+    [0x1F] = { INSN_NOP, AM_IMP, 1 },
+    [0x22] = { INSN_NOP, AM_IMM, 2 },
+    [0x23] = { INSN_NOP, AM_IMP, 1 },
+    [0x27] = { INSN_NOP, AM_IMP, 1 },
+    [0x2B] = { INSN_NOP, AM_IMP, 1 },
+    [0x2F] = { INSN_NOP, AM_IMP, 1 },
+    [0x32] = { INSN_AND, AM_IZP, 5 },
+    [0x33] = { INSN_NOP, AM_IMP, 1 },
+    [0x34] = { INSN_BIT, AM_ZPX, 4 },
+    [0x37] = { INSN_NOP, AM_IMP, 1 },
+    [0x3A] = { INSN_DEC, AM_ACC, 2 },
+    [0x3B] = { INSN_NOP, AM_IMP, 1 },
+    [0x3C] = { INSN_BIT, AM_ABX, 4 },
+    [0x3E] = { INSN_ROL, AM_ABX, 6 },
+    [0x3F] = { INSN_NOP, AM_IMP, 1 },
+    [0x42] = { INSN_NOP, AM_IMM, 2 },
+    [0x43] = { INSN_NOP, AM_IMP, 1 },
+    [0x44] = { INSN_NOP, AM_ZP, 3 },
+    [0x47] = { INSN_NOP, AM_IMP, 1 },
+    [0x4B] = { INSN_NOP, AM_IMP, 1 },
+    [0x4F] = { INSN_NOP, AM_IMP, 1 },
+    [0x52] = { INSN_EOR, AM_IZP, 5 },
+    [0x53] = { INSN_NOP, AM_IMP, 1 },
+    [0x54] = { INSN_NOP, AM_ZPX, 4 },
+    [0x57] = { INSN_NOP, AM_IMP, 1 },
+    [0x5A] = { INSN_PHY, AM_IMP, 3 },
+    [0x5B] = { INSN_NOP, AM_IMP, 1 },
+    [0x5C] = { INSN_NOP, AM_ABS, 8 },
+    [0x5E] = { INSN_LSR, AM_ABX, 6 },
+    [0x5F] = { INSN_NOP, AM_IMP, 1 },
+    [0x62] = { INSN_NOP, AM_IMM, 2 },
+    [0x63] = { INSN_NOP, AM_IMP, 1 },
+    [0x64] = { INSN_STZ, AM_ZP, 3 },
+    [0x67] = { INSN_NOP, AM_IMP, 1 },
+    [0x6B] = { INSN_NOP, AM_IMP, 1 },
+    [0x6C] = { INSN_JMP, AM_IND, 6 },
+    [0x6F] = { INSN_NOP, AM_IMP, 1 },
+    [0x72] = { INSN_ADC, AM_IZP, 5 },
+    [0x73] = { INSN_NOP, AM_IMP, 1 },
+    [0x74] = { INSN_STZ, AM_ZPX, 4 },
+    [0x77] = { INSN_NOP, AM_IMP, 1 },
+    [0x7A] = { INSN_PLY, AM_IMP, 4 },
+    [0x7B] = { INSN_NOP, AM_IMP, 1 },
+    [0x7C] = { INSN_JMP, AM_IAX, 6 },
+    [0x7E] = { INSN_ROR, AM_ABX, 6 },
+    [0x7F] = { INSN_NOP, AM_IMP, 1 },
+    [0x80] = { INSN_BRA, AM_REL, 2 },
+    [0x82] = { INSN_NOP, AM_IMM, 2 },
+    [0x83] = { INSN_NOP, AM_IMP, 1 },
+    [0x87] = { INSN_NOP, AM_IMP, 1 },
+    [0x89] = { INSN_BIT, AM_IMM, 2 },
+    [0x8B] = { INSN_NOP, AM_IMP, 1 },
+    [0x8F] = { INSN_NOP, AM_IMP, 1 },
+    [0x92] = { INSN_STA, AM_IZP, 5 },
+    [0x93] = { INSN_NOP, AM_IMP, 1 },
+    [0x97] = { INSN_NOP, AM_IMP, 1 },
+    [0x9B] = { INSN_NOP, AM_IMP, 1 },
+    [0x9C] = { INSN_STZ, AM_ABS, 4 },
+    [0x9E] = { INSN_STZ, AM_ABX, 5 },
+    [0x9F] = { INSN_NOP, AM_IMP, 1 },
+    [0xA3] = { INSN_NOP, AM_IMP, 1 },
+    [0xA7] = { INSN_NOP, AM_IMP, 1 },
+    [0xAB] = { INSN_NOP, AM_IMP, 1 },
+    [0xAF] = { INSN_NOP, AM_IMP, 1 },
+    [0xB2] = { INSN_LDA, AM_IZP, 5 },
+    [0xB3] = { INSN_NOP, AM_IMP, 1 },
+    [0xB7] = { INSN_NOP, AM_IMP, 1 },
+    [0xBB] = { INSN_NOP, AM_IMP, 1 },
+    [0xBF] = { INSN_NOP, AM_IMP, 1 },
+    [0xC2] = { INSN_NOP, AM_IMM, 2 },
+    [0xC3] = { INSN_NOP, AM_IMP, 1 },
+    [0xC7] = { INSN_NOP, AM_IMP, 1 },
+    [0xCB] = { INSN_NOP, AM_IMP, 1 },
+    [0xCF] = { INSN_NOP, AM_IMP, 1 },
+    [0xD2] = { INSN_CMP, AM_IZP, 5 },
+    [0xD3] = { INSN_NOP, AM_IMP, 1 },
+    [0xD4] = { INSN_NOP, AM_ZPX, 4 },
+    [0xD7] = { INSN_NOP, AM_IMP, 1 },
+    [0xDA] = { INSN_PHX, AM_IMP, 3 },
+    [0xDB] = { INSN_NOP, AM_IMP, 1 },
+    [0xDC] = { INSN_NOP, AM_ABS, 4 },
+    [0xDF] = { INSN_NOP, AM_IMP, 1 },
+    [0xE2] = { INSN_NOP, AM_IMM, 2 },
+    [0xE3] = { INSN_NOP, AM_IMP, 1 },
+    [0xE7] = { INSN_NOP, AM_IMP, 1 },
+    [0xEB] = { INSN_NOP, AM_IMP, 1 },
+    [0xEF] = { INSN_NOP, AM_IMP, 1 },
+    [0xF2] = { INSN_SBC, AM_IZP, 5 },
+    [0xF3] = { INSN_NOP, AM_IMP, 1 },
+    [0xF4] = { INSN_NOP, AM_ZPX, 4 },
+    [0xF7] = { INSN_NOP, AM_IMP, 1 },
+    [0xFA] = { INSN_PLX, AM_IMP, 4 },
+    [0xFB] = { INSN_NOP, AM_IMP, 1 },
+    [0xFC] = { INSN_NOP, AM_ABS, 4 },
+    [0xFF] = { INSN_NOP, AM_IMP, 1 },
+};
+
+/* Rockwell bit instructions, the bit number is in the opcode high nibble */
+static const MCS6500Opcode opcodes_bit_ops[256] = {
+#define BIT_OPS(n) \
+    [0x07 | (n) << 4] = { INSN_RMB, AM_ZP, 5 }, \
+    [0x87 | (n) << 4] = { INSN_SMB, AM_ZP, 5 }, \
+    [0x0F | (n) << 4] = { INSN_BBR, AM_ZPR, 5 }, \
+    [0x8F | (n) << 4] = { INSN_BBS, AM_ZPR, 5 }
+    BIT_OPS(0), BIT_OPS(1), BIT_OPS(2), BIT_OPS(3),
+    BIT_OPS(4), BIT_OPS(5), BIT_OPS(6), BIT_OPS(7),
+#undef BIT_OPS
+};
+
+static const MCS6500Opcode opcodes_wait_stop[256] = {
+    [0xCB] = { INSN_WAI, AM_IMP, 3 },
+    [0xDB] = { INSN_STP, AM_IMP, 3 },
+};
+
+/* Opcode table of each feature set, built by mcs6500_cpu_tcg_init() */
+static MCS6500Opcode opcode_tables[1 << MCS6500_FEATURE_COUNT][256];
+
+/* Forward branches a TB may be waiting for, see gen_branch() */
+#define MAX_JOINS 4
 
 typedef struct DisasContext {
     DisasContextBase base;
+
+    CPUMCS6500State *env;
+
+    /* Pages 0 and 1 are accessed through cpu_zp_ram */
+    bool zp_ram;
+
+    /* D is set, ADC and SBC work on BCD */
+    bool decimal;
+
+    /* Model features and the matching opcode table */
+    uint32_t features;
+    const MCS6500Opcode *opcodes;
+
+    /* The first instruction of the TB is a load which may be polled */
+    bool idle_load;
+
+    /* Execution count of the TB, when profiling */
+    MCS6500TBProfile *profile;
+
+    /* Address, opcode and raw operand of the instruction being translated */
+    target_ulong pc;
+    uint8_t opcode;
+    uint16_t operand;
+
+    /*
+     * Static cycle count of the TB up to the current instruction included,
+     * added to cpu_cycles once when leaving the TB or reaching a join.
+     */
+    int cycles;
+
+    /*
+     * Taken forward branches which stay in the TB, they jump to @label
+     * once the translation reaches @dest. A NULL label has been placed.
+     */
+    struct {
+        target_ulong dest;
+        TCGLabel *label;
+    } joins[MAX_JOINS];
+    int nb_joins;
 } DisasContext;
 
+/*
+ * NMOS decimal mode: the result and C are the BCD ones, N and V come from
+ * the sum before the high digit is adjusted and Z from the binary sum.
+ */
+static uint32_t bcd_adc_entry(int a, int b, int c)
+{
+    int lo = (a & 0x0f) + (b & 0x0f) + c;
+    int sum;
+    int ssum;
+    uint8_t n;
+    uint8_t z = (a + b + c) & 0xff;
+    bool v;
+
+    if (lo >= 0x0a) {
+        lo = ((lo + 0x06) & 0x0f) + 0x10;
+    }
+    sum = (a & 0xf0) + (b & 0xf0) + lo;
+    ssum = (int8_t)(a & 0xf0) + (int8_t)(b & 0xf0) + lo;
+    n = sum & 0x80;
+    v = ssum < -128 || ssum > 127;
+
+    if (sum >= 0xa0) {
+        sum += 0x60;
+    }
+
+    return (sum & 0xff) | n << 8 | z << 16 | (sum >= 0x100) << 24
+        | (uint32_t)v << 31;
+}
+
+static uint8_t bcd_sbc_entry(int a, int b, int c)
+{
+    int lo = (a & 0x0f) - (b & 0x0f) + c - 1;
+    int diff;
+
+    if (lo < 0) {
+        lo = ((lo - 0x06) & 0x0f) - 0x10;
+    }
+    diff = (a & 0xf0) - (b & 0xf0) + lo;
+    if (diff < 0) {
+        diff -= 0x60;
+    }
+
+    return diff & 0xff;
+}
+
+static uint8_t bcd_sbc_cmos_entry(int a, int b, int c)
+{
+    int lo = (a & 0x0f) - (b & 0x0f) + c - 1;
+    int diff = a - b + c - 1;
+
+    if (diff < 0) {
+        diff -= 0x60;
+    }
+    if (lo < 0) {
+        diff -= 0x06;
+    }
+
+    return diff & 0xff;
+}
+
+static void bcd_init(void)
+{
+    for (int c = 0; c < 2; ++c) {
+        for (int a = 0; a < 0x100; ++a) {
+            for (int b = 0; b < 0x100; ++b) {
+                int i = c << 16 | a << 8 | b;
+
+                bcd_adc[i] = bcd_adc_entry(a, b, c);
+                bcd_sbc[i] = bcd_sbc_entry(a, b, c);
+                bcd_sbc_cmos[i] = bcd_sbc_cmos_entry(a, b, c);
+            }
+        }
+    }
+}
+
+static void opcode_tables_overlay(MCS6500Opcode *table,
+                                  const MCS6500Opcode *overlay)
+{
+    for (int i = 0; i < 256; ++i) {
+        if (overlay[i].insn != INSN_ILL) {
+            table[i] = overlay[i];
+        }
+    }
+}
+
+static void opcode_tables_init(void)
+{
+    for (uint32_t features = 0; features < ARRAY_SIZE(opcode_tables);
+         ++features) {
+        MCS6500Opcode *table = opcode_tables[features];
+
+        memcpy(table, opcodes, sizeof(opcodes));
+        if (features & (1U << MCS6500_FEATURE_UNDOC)) {
+            opcode_tables_overlay(table, opcodes_undoc);
+        }
+        if (features & (1U << MCS6500_FEATURE_CMOS)) {
+            opcode_tables_overlay(table, opcodes_cmos);
+        }
+        if (features & (1U << MCS6500_FEATURE_BIT_OPS)) {
+            opcode_tables_overlay(table, opcodes_bit_ops);
+        }
+        if (features & (1U << MCS6500_FEATURE_WAIT_STOP)) {
+            opcode_tables_overlay(table, opcodes_wait_stop);
+        }
+    }
+}
+
+void mcs6500_cpu_tcg_init(void)
+{
+    bcd_init();
+    opcode_tables_init();
+
+#define MCS6500_REG_OFFS(x) offsetof(CPUMCS6500State, x)
+    cpu_pc = tcg_global_mem_new_i32(cpu_env, MCS6500_REG_OFFS(pc), "pc");
+    cpu_sr = tcg_global_mem_new_i32(cpu_env, MCS6500_REG_OFFS(sr), "sr");
+    cpu_sp = tcg_global_mem_new_i32(cpu_env, MCS6500_REG_OFFS(sp), "sp");
+    cpu_x = tcg_global_mem_new_i32(cpu_env, MCS6500_REG_OFFS(x), "x");
+    cpu_y = tcg_global_mem_new_i32(cpu_env, MCS6500_REG_OFFS(y), "y");
+    cpu_acc = tcg_global_mem_new_i32(cpu_env, MCS6500_REG_OFFS(acc), "a");
+    cpu_cc_n = tcg_global_mem_new_i32(cpu_env, MCS6500_REG_OFFS(cc_n), "cc_n");
+    cpu_cc_z = tcg_global_mem_new_i32(cpu_env, MCS6500_REG_OFFS(cc_z), "cc_z");
+    cpu_cc_c = tcg_global_mem_new_i32(cpu_env, MCS6500_REG_OFFS(cc_c), "cc_c");
+    cpu_cc_v = tcg_global_mem_new_i32(cpu_env, MCS6500_REG_OFFS(cc_v), "cc_v");
+    cpu_zp_ram = tcg_global_mem_new_ptr(cpu_env, MCS6500_REG_OFFS(zp_ram),
+                                        "zp_ram");
+    cpu_cycles = tcg_global_mem_new_i64(cpu_env, MCS6500_REG_OFFS(cycles),
+                                        "cycles");
+#undef MCS6500_REG_OFFS
+}
+
+/*
+ * Memory accesses
+ */
+
+static bool has_feature(DisasContext *ctx, int feature)
+{
+    return ctx->features & (1U << feature);
+}
+
+/*
+ * Cycle accounting
+ */
+
+static void gen_update_cycles(DisasContext *ctx)
+{
+    tcg_gen_addi_i64(cpu_cycles, cpu_cycles, ctx->cycles);
+}
+
+/* Indexed reads take one more cycle when @base + @index crosses a page */
+static void gen_page_penalty(TCGv base, TCGv index)
+{
+    TCGv tmp = tcg_temp_new();
+    TCGv_i64 tmp64 = tcg_temp_new_i64();
+
+    tcg_gen_andi_tl(tmp, base, 0xff);
+    tcg_gen_add_tl(tmp, tmp, index);
+    tcg_gen_shri_tl(tmp, tmp, 8);
+    tcg_gen_extu_i32_i64(tmp64, tmp);
+    tcg_gen_add_i64(cpu_cycles, cpu_cycles, tmp64);
+
+    tcg_temp_free_i64(tmp64);
+    tcg_temp_free(tmp);
+}
+
+/*
+ * Host address of @addr, which must lie in pages 0 or 1, when those are
+ * accessed directly.
+ */
+static TCGv_ptr gen_zp_ptr(TCGv addr)
+{
+    TCGv_ptr ptr = tcg_temp_new_ptr();
+
+    tcg_gen_ext_i32_ptr(ptr, addr);
+    tcg_gen_add_ptr(ptr, ptr, cpu_zp_ram);
+
+    return ptr;
+}
+
+/* @zp tells @addr is known to lie in pages 0 or 1 */
+static void gen_ld8(DisasContext *ctx, TCGv val, TCGv addr, bool zp)
+{
+    if (zp && ctx->zp_ram) {
+        TCGv_ptr ptr = gen_zp_ptr(addr);
+
+        tcg_gen_ld8u_tl(val, ptr, 0);
+        tcg_temp_free_ptr(ptr);
+    } else {
+        tcg_gen_qemu_ld_tl(val, addr, MMU_NOMMU, MO_UB);
+    }
+}
+
+static void gen_st8(DisasContext *ctx, TCGv val, TCGv addr, bool zp)
+{
+    if (zp && ctx->zp_ram) {
+        TCGv_ptr ptr = gen_zp_ptr(addr);
+
+        tcg_gen_st8_tl(val, ptr, 0);
+        tcg_temp_free_ptr(ptr);
+    } else {
+        tcg_gen_qemu_st_tl(val, addr, MMU_NOMMU, MO_UB);
+    }
+}
+
+/*
+ * Load a little endian 16 bits word. The high byte address is computed by
+ * incrementing the bits of @addr selected by @mask only, which models both the
+ * zero page wrap around and the NMOS JMP ($xxFF) bug.
+ */
+static void gen_ld_word(DisasContext *ctx, TCGv dst, TCGv addr,
+                        target_ulong mask, bool zp)
+{
+    TCGv hi = tcg_temp_new();
+    TCGv tmp = tcg_temp_new();
+
+    tcg_gen_addi_tl(hi, addr, 1);
+    tcg_gen_andi_tl(hi, hi, mask);
+    tcg_gen_andi_tl(tmp, addr, ~mask & PC_MASK);
+    tcg_gen_or_tl(hi, hi, tmp);
+
+    gen_ld8(ctx, dst, addr, zp);
+    gen_ld8(ctx, hi, hi, zp);
+    tcg_gen_deposit_tl(dst, dst, hi, 8, 8);
+
+    tcg_temp_free(tmp);
+    tcg_temp_free(hi);
+}
+
+static void gen_push(DisasContext *ctx, TCGv val)
+{
+    TCGv addr = tcg_temp_new();
+
+    tcg_gen_ori_tl(addr, cpu_sp, STACK_BASE);
+    gen_st8(ctx, val, addr, true);
+    tcg_gen_subi_tl(cpu_sp, cpu_sp, 1);
+    tcg_gen_andi_tl(cpu_sp, cpu_sp, 0xff);
+
+    tcg_temp_free(addr);
+}
+
+static void gen_pushi(DisasContext *ctx, uint8_t val)
+{
+    TCGv tmp = tcg_const_tl(val);
+
+    gen_push(ctx, tmp);
+
+    tcg_temp_free(tmp);
+}
+
+static void gen_pull(DisasContext *ctx, TCGv val)
+{
+    TCGv addr = tcg_temp_new();
+
+    tcg_gen_addi_tl(cpu_sp, cpu_sp, 1);
+    tcg_gen_andi_tl(cpu_sp, cpu_sp, 0xff);
+    tcg_gen_ori_tl(addr, cpu_sp, STACK_BASE);
+    gen_ld8(ctx, val, addr, true);
+
+    tcg_temp_free(addr);
+}
+
+/* Whether the effective address of @mode always lies in pages 0 or 1 */
+static bool ea_is_zp(DisasContext *ctx, int mode)
+{
+    switch (mode) {
+    case AM_ZP:
+    case AM_ZPX:
+    case AM_ZPY:
+        return true;
+    case AM_ABS:
+        return ctx->operand < ZP_RAM_SIZE;
+    default:
+        return false;
+    }
+}
+
+/*
+ * Compute the effective address of the current instruction operand, @read
+ * tells whether page crossing penalties apply.
+ */
+static TCGv gen_ea(DisasContext *ctx, int mode, bool read)
+{
+    TCGv ea = tcg_temp_new();
+
+    switch (mode) {
+    case AM_ZP:
+    case AM_ABS:
+        tcg_gen_movi_tl(ea, ctx->operand);
+        break;
+    case AM_ZPX:
+        tcg_gen_addi_tl(ea, cpu_x, ctx->operand);
+        tcg_gen_andi_tl(ea, ea, 0xff);
+        break;
+    case AM_ZPY:
+        tcg_gen_addi_tl(ea, cpu_y, ctx->operand);
+        tcg_gen_andi_tl(ea, ea, 0xff);
+        break;
+    case AM_ABX:
+        if (read) {
+            gen_page_penalty(tcg_constant_tl(ctx->operand), cpu_x);
+        }
+        tcg_gen_addi_tl(ea, cpu_x, ctx->operand);
+        tcg_gen_andi_tl(ea, ea, PC_MASK);
+        break;
+    case AM_ABY:
+        if (read) {
+            gen_page_penalty(tcg_constant_tl(ctx->operand), cpu_y);
+        }
+        tcg_gen_addi_tl(ea, cpu_y, ctx->operand);
+        tcg_gen_andi_tl(ea, ea, PC_MASK);
+        break;
+    case AM_IND:
+        /*
+         * The 65C02 fixed the JMP ($xxFF) bug, its high byte of $01FF is
+         * read from $0200 which is past the zero page and stack RAM.
+         */
+        tcg_gen_movi_tl(ea, ctx->operand);
+        if (has_feature(ctx, MCS6500_FEATURE_CMOS)) {
+            gen_ld_word(ctx, ea, ea, PC_MASK,
+                        ctx->operand < ZP_RAM_SIZE - 1);
+        } else {
+            gen_ld_word(ctx, ea, ea, 0xff, ctx->operand < ZP_RAM_SIZE);
+        }
+        break;
+    case AM_IAX:
+        tcg_gen_addi_tl(ea, cpu_x, ctx->operand);
+        tcg_gen_andi_tl(ea, ea, PC_MASK);
+        gen_ld_word(ctx, ea, ea, PC_MASK, false);
+        break;
+    case AM_IZP:
+        tcg_gen_movi_tl(ea, ctx->operand);
+        gen_ld_word(ctx, ea, ea, 0xff, true);
+        break;
+    case AM_IZX:
+        tcg_gen_addi_tl(ea, cpu_x, ctx->operand);
+        tcg_gen_andi_tl(ea, ea, 0xff);
+        gen_ld_word(ctx, ea, ea, 0xff, true);
+        break;
+    case AM_IZY:
+        tcg_gen_movi_tl(ea, ctx->operand);
+        gen_ld_word(ctx, ea, ea, 0xff, true);
+        if (read) {
+            gen_page_penalty(ea, cpu_y);
+        }
+        tcg_gen_add_tl(ea, ea, cpu_y);
+        tcg_gen_andi_tl(ea, ea, PC_MASK);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    return ea;
+}
+
+/* Fetch the value of the current instruction operand */
+static TCGv gen_load_operand(DisasContext *ctx, int mode)
+{
+    TCGv val = tcg_temp_new();
+    TCGv ea;
+
+    if (mode == AM_IMM) {
+        tcg_gen_movi_tl(val, ctx->operand);
+        return val;
+    }
+
+    ea = gen_ea(ctx, mode, true);
+    gen_ld8(ctx, val, ea, ea_is_zp(ctx, mode));
+    tcg_temp_free(ea);
+
+    return val;
+}
+
+static void gen_store_operand(DisasContext *ctx, int mode, TCGv val)
+{
+    TCGv ea = gen_ea(ctx, mode, false);
+
+    gen_st8(ctx, val, ea, ea_is_zp(ctx, mode));
+
+    tcg_temp_free(ea);
+}
+
+/*
+ * Status register
+ *
+ * N, Z, C and V are kept in the cpu_cc_* globals in the form instructions
+ * produce them, the status register is only packed when it is pushed.
+ *
+ * Each update is a plain move, which the TCG liveness pass drops when the
+ * next instruction overwrites the flag. Only the softmmu accesses keep them:
+ * the globals are synced before each one for watchpoints and icount I/O.
+ * Zero page and stack accesses through cpu_zp_ram don't sync them.
+ */
+
+static void gen_update_nz(TCGv val)
+{
+    tcg_gen_mov_tl(cpu_cc_n, val);
+    tcg_gen_mov_tl(cpu_cc_z, val);
+}
+
+/* Pack the status register into @dst, see cpu_get_sr() */
+static void gen_compute_sr(TCGv dst)
+{
+    TCGv tmp = tcg_temp_new();
+
+    tcg_gen_andi_tl(dst, cpu_cc_n, 0x80);
+    tcg_gen_andi_tl(tmp, cpu_cc_v, 0x80);
+    tcg_gen_shri_tl(tmp, tmp, SR_N - SR_V);
+    tcg_gen_or_tl(dst, dst, tmp);
+    tcg_gen_setcondi_tl(TCG_COND_EQ, tmp, cpu_cc_z, 0);
+    tcg_gen_shli_tl(tmp, tmp, SR_Z);
+    tcg_gen_or_tl(dst, dst, tmp);
+    tcg_gen_or_tl(dst, dst, cpu_cc_c);
+    tcg_gen_or_tl(dst, dst, cpu_sr);
+    tcg_gen_ori_tl(dst, dst, 1 << SR_E);
+
+    tcg_temp_free(tmp);
+}
+
+/* Unpack @val into the status register, see cpu_set_sr() */
+static void gen_split_sr(TCGv val)
+{
+    tcg_gen_andi_tl(cpu_cc_n, val, 1 << SR_N);
+    tcg_gen_shli_tl(cpu_cc_v, val, SR_N - SR_V);
+    tcg_gen_andi_tl(cpu_cc_v, cpu_cc_v, 0x80);
+    tcg_gen_andi_tl(cpu_cc_z, val, 1 << SR_Z);
+    tcg_gen_xori_tl(cpu_cc_z, cpu_cc_z, 1 << SR_Z);
+    tcg_gen_andi_tl(cpu_cc_c, val, 1 << SR_C);
+    tcg_gen_andi_tl(cpu_sr, val, SR_STORED_MASK);
+}
+
+/*
+ * Operations
+ */
+
+static void gen_adc(TCGv val)
+{
+    TCGv res = tcg_temp_new();
+    TCGv tmp = tcg_temp_new();
+
+    tcg_gen_add_tl(res, cpu_acc, val);
+    tcg_gen_add_tl(res, res, cpu_cc_c);
+
+    /* Overflow when both operands have the same sign and the result not */
+    tcg_gen_xor_tl(tmp, cpu_acc, res);
+    tcg_gen_xor_tl(val, val, res);
+    tcg_gen_and_tl(cpu_cc_v, tmp, val);
+
+    tcg_gen_shri_tl(cpu_cc_c, res, 8);
+
+    tcg_gen_andi_tl(cpu_acc, res, 0xff);
+    gen_update_nz(cpu_acc);
+
+    tcg_temp_free(tmp);
+    tcg_temp_free(res);
+}
+
+static void gen_sbc(TCGv val)
+{
+    tcg_gen_xori_tl(val, val, 0xff);
+    gen_adc(val);
+}
+
+/* Host address of the entry of @table for the operation of A and @val */
+static TCGv_ptr gen_bcd_ptr(void *table, int shift, TCGv val)
+{
+    TCGv idx = tcg_temp_new();
+    TCGv_ptr ptr = tcg_temp_new_ptr();
+    TCGv_ptr base = tcg_const_ptr(table);
+
+    tcg_gen_shli_tl(idx, cpu_cc_c, 16);
+    tcg_gen_deposit_tl(idx, idx, cpu_acc, 8, 8);
+    tcg_gen_or_tl(idx, idx, val);
+    tcg_gen_shli_tl(idx, idx, shift);
+    tcg_gen_ext_i32_ptr(ptr, idx);
+    tcg_gen_add_ptr(ptr, ptr, base);
+
+    tcg_temp_free_ptr(base);
+    tcg_temp_free(idx);
+
+    return ptr;
+}
+
+/*
+ * Decimal mode, only translated in TBs run with D set. An entry of bcd_adc
+ * holds A in bits 0-7, the value N is taken from in bits 8-15, the one Z
+ * is taken from in bits 16-23, C in bit 24 and V in bit 31.
+ */
+static void gen_adc_decimal(TCGv val)
+{
+    TCGv_ptr ptr = gen_bcd_ptr(bcd_adc, 2, val);
+    TCGv res = tcg_temp_new();
+
+    tcg_gen_ld_i32(res, ptr, 0);
+    tcg_gen_extract_tl(cpu_acc, res, 0, 8);
+    tcg_gen_extract_tl(cpu_cc_n, res, 8, 8);
+    tcg_gen_extract_tl(cpu_cc_z, res, 16, 8);
+    tcg_gen_extract_tl(cpu_cc_c, res, 24, 1);
+    tcg_gen_shri_tl(cpu_cc_v, res, 24);
+
+    tcg_temp_free(res);
+    tcg_temp_free_ptr(ptr);
+}
+
+static void gen_sbc_decimal(TCGv val, uint8_t *table)
+{
+    TCGv_ptr ptr = gen_bcd_ptr(table, 0, val);
+    TCGv res = tcg_temp_new();
+
+    tcg_gen_ld8u_tl(res, ptr, 0);
+    gen_sbc(val);
+    tcg_gen_mov_tl(cpu_acc, res);
+
+    tcg_temp_free(res);
+    tcg_temp_free_ptr(ptr);
+}
+
+/* The 65C02 takes one more cycle in decimal mode to get N and Z right */
+static void gen_adc_insn(DisasContext *ctx, TCGv val)
+{
+    if (!ctx->decimal) {
+        gen_adc(val);
+        return;
+    }
+
+    gen_adc_decimal(val);
+    if (has_feature(ctx, MCS6500_FEATURE_CMOS)) {
+        gen_update_nz(cpu_acc);
+        ctx->cycles++;
+    }
+}
+
+static void gen_sbc_insn(DisasContext *ctx, TCGv val)
+{
+    if (!ctx->decimal) {
+        gen_sbc(val);
+    } else if (has_feature(ctx, MCS6500_FEATURE_CMOS)) {
+        gen_sbc_decimal(val, bcd_sbc_cmos);
+        gen_update_nz(cpu_acc);
+        ctx->cycles++;
+    } else {
+        gen_sbc_decimal(val, bcd_sbc);
+    }
+}
+
+static void gen_cmp(TCGv reg, TCGv val)
+{
+    TCGv tmp = tcg_temp_new();
+
+    tcg_gen_sub_tl(tmp, reg, val);
+    tcg_gen_setcond_tl(TCG_COND_GEU, cpu_cc_c, reg, val);
+    tcg_gen_andi_tl(tmp, tmp, 0xff);
+    gen_update_nz(tmp);
+
+    tcg_temp_free(tmp);
+}
+
+static void gen_bit(TCGv val)
+{
+    tcg_gen_and_tl(cpu_cc_z, cpu_acc, val);
+    tcg_gen_mov_tl(cpu_cc_n, val);
+    tcg_gen_shli_tl(cpu_cc_v, val, SR_N - SR_V);
+}
+
+/* ANC: AND, with C set as N */
+static void gen_anc(TCGv val)
+{
+    tcg_gen_and_tl(cpu_acc, cpu_acc, val);
+    gen_update_nz(cpu_acc);
+    tcg_gen_shri_tl(cpu_cc_c, cpu_acc, 7);
+}
+
+/*
+ * ARR: AND then ROR, C is bit 6 of the result and V bit 6 xor bit 5. The
+ * decimal mode adjustments of the NMOS are not modelled.
+ */
+static void gen_arr(TCGv val)
+{
+    tcg_gen_and_tl(cpu_acc, cpu_acc, val);
+    tcg_gen_shri_tl(cpu_acc, cpu_acc, 1);
+    tcg_gen_deposit_tl(cpu_acc, cpu_acc, cpu_cc_c, 7, 1);
+    gen_update_nz(cpu_acc);
+    tcg_gen_extract_tl(cpu_cc_c, cpu_acc, 6, 1);
+    tcg_gen_shli_tl(val, cpu_acc, 1);
+    tcg_gen_shli_tl(cpu_cc_v, cpu_acc, 2);
+    tcg_gen_xor_tl(cpu_cc_v, cpu_cc_v, val);
+}
+
+/* SBX: X = (A & X) - operand, flags as CMP */
+static void gen_sbx(TCGv val)
+{
+    TCGv tmp = tcg_temp_new();
+
+    tcg_gen_and_tl(tmp, cpu_acc, cpu_x);
+    gen_cmp(tmp, val);
+    tcg_gen_sub_tl(cpu_x, tmp, val);
+    tcg_gen_andi_tl(cpu_x, cpu_x, 0xff);
+
+    tcg_temp_free(tmp);
+}
+
+/* Read-modify-write operations, @val is updated in place */
+typedef void GenRMWFn(TCGv val);
+
+static void gen_asl(TCGv val)
+{
+    tcg_gen_shri_tl(cpu_cc_c, val, 7);
+    tcg_gen_shli_tl(val, val, 1);
+    tcg_gen_andi_tl(val, val, 0xff);
+    gen_update_nz(val);
+}
+
+static void gen_lsr(TCGv val)
+{
+    tcg_gen_andi_tl(cpu_cc_c, val, 1);
+    tcg_gen_shri_tl(val, val, 1);
+    gen_update_nz(val);
+}
+
+static void gen_rol(TCGv val)
+{
+    tcg_gen_shli_tl(val, val, 1);
+    tcg_gen_or_tl(val, val, cpu_cc_c);
+    tcg_gen_shri_tl(cpu_cc_c, val, 8);
+    tcg_gen_andi_tl(val, val, 0xff);
+    gen_update_nz(val);
+}
+
+static void gen_ror(TCGv val)
+{
+    TCGv carry = tcg_temp_new();
+
+    tcg_gen_mov_tl(carry, cpu_cc_c);
+    tcg_gen_andi_tl(cpu_cc_c, val, 1);
+    tcg_gen_shri_tl(val, val, 1);
+    tcg_gen_deposit_tl(val, val, carry, 7, 1);
+    gen_update_nz(val);
+
+    tcg_temp_free(carry);
+}
+
+static void gen_inc(TCGv val)
+{
+    tcg_gen_addi_tl(val, val, 1);
+    tcg_gen_andi_tl(val, val, 0xff);
+    gen_update_nz(val);
+}
+
+static void gen_dec(TCGv val)
+{
+    tcg_gen_subi_tl(val, val, 1);
+    tcg_gen_andi_tl(val, val, 0xff);
+    gen_update_nz(val);
+}
+
+/* TSB and TRB: Z tells whether A and the operand have bits in common */
+static void gen_tsb(TCGv val)
+{
+    tcg_gen_and_tl(cpu_cc_z, cpu_acc, val);
+    tcg_gen_or_tl(val, val, cpu_acc);
+}
+
+static void gen_trb(TCGv val)
+{
+    tcg_gen_and_tl(cpu_cc_z, cpu_acc, val);
+    tcg_gen_andc_tl(val, val, cpu_acc);
+}
+
+/* Undocumented RMW instructions which go on with an ALU operation */
+static void gen_slo(TCGv val)
+{
+    gen_asl(val);
+    tcg_gen_or_tl(cpu_acc, cpu_acc, val);
+    gen_update_nz(cpu_acc);
+}
+
+static void gen_rla(TCGv val)
+{
+    gen_rol(val);
+    tcg_gen_and_tl(cpu_acc, cpu_acc, val);
+    gen_update_nz(cpu_acc);
+}
+
+static void gen_sre(TCGv val)
+{
+    gen_lsr(val);
+    tcg_gen_xor_tl(cpu_acc, cpu_acc, val);
+    gen_update_nz(cpu_acc);
+}
+
+static void gen_dcp(TCGv val)
+{
+    gen_dec(val);
+    gen_cmp(cpu_acc, val);
+}
+
+/* The value written back is copied to @out if not NULL */
+static void gen_rmw(DisasContext *ctx, int mode, GenRMWFn *fn, TCGv out)
+{
+    TCGv ea;
+    TCGv val;
+
+    if (mode == AM_ACC) {
+        fn(cpu_acc);
+        return;
+    }
+
+    ea = gen_ea(ctx, mode, false);
+    val = tcg_temp_new();
+    gen_ld8(ctx, val, ea, ea_is_zp(ctx, mode));
+    fn(val);
+    gen_st8(ctx, val, ea, ea_is_zp(ctx, mode));
+    if (out) {
+        tcg_gen_mov_tl(out, val);
+    }
+
+    tcg_temp_free(val);
+    tcg_temp_free(ea);
+}
+
+/* The 65C02 only takes the last cycle of a shift on abs,X across pages */
+static void gen_shift(DisasContext *ctx, int mode, GenRMWFn *fn)
+{
+    if (mode == AM_ABX && has_feature(ctx, MCS6500_FEATURE_CMOS)) {
+        gen_page_penalty(tcg_constant_tl(ctx->operand), cpu_x);
+    }
+    gen_rmw(ctx, mode, fn, NULL);
+}
+
+/* RMB and SMB, the bit number is in the opcode */
+static void gen_bit_rmw(DisasContext *ctx, bool set)
+{
+    TCGv ea = gen_ea(ctx, AM_ZP, false);
+    TCGv val = tcg_temp_new();
+    int bit = (ctx->opcode >> 4) & 7;
+
+    gen_ld8(ctx, val, ea, true);
+    if (set) {
+        tcg_gen_ori_tl(val, val, 1 << bit);
+    } else {
+        tcg_gen_andi_tl(val, val, ~(1 << bit) & 0xff);
+    }
+    gen_st8(ctx, val, ea, true);
+
+    tcg_temp_free(val);
+    tcg_temp_free(ea);
+}
+
+static void gen_transfer(TCGv dst, TCGv src)
+{
+    tcg_gen_mov_tl(dst, src);
+    gen_update_nz(dst);
+}
+
+/*
+ * Control flow
+ */
+
+static void gen_goto_tb(DisasContext *ctx, int n, target_ulong dest)
+{
+    const TranslationBlock *tb = ctx->base.tb;
+
+    dest &= PC_MASK;
+    gen_update_cycles(ctx);
+
+    if (translator_use_goto_tb(&ctx->base, dest)) {
+        tcg_gen_goto_tb(n);
+        tcg_gen_movi_tl(cpu_pc, dest);
+        tcg_gen_exit_tb(tb, n);
+    } else {
+        tcg_gen_movi_tl(cpu_pc, dest);
+        tcg_gen_lookup_and_goto_ptr();
+    }
+    ctx->base.is_jmp = DISAS_NORETURN;
+}
+
+/* Branch target, BBR and BBS have the offset after the zero page address */
+static target_ulong branch_dest(DisasContext *ctx)
+{
+    if (ctx->opcodes[ctx->opcode].mode == AM_ZPR) {
+        return ctx->base.pc_next + (int8_t)(ctx->operand >> 8);
+    }
+    return ctx->base.pc_next + (int8_t)ctx->operand;
+}
+
+/*
+ * Loops waiting for an interrupt or a device, which change nothing while
+ * they spin: a jump back to the start of the TB, either on itself or after
+ * a load, as in "wait: LDA $2002; BPL wait" or "wait: LDA nmi_done; BEQ wait".
+ */
+static bool is_idle_loop(DisasContext *ctx, target_ulong dest)
+{
+    if ((dest & PC_MASK) != (ctx->base.pc_first & PC_MASK)) {
+        return false;
+    }
+
+    switch (ctx->base.num_insns) {
+    case 1:
+        return true;
+    case 2:
+        return ctx->idle_load;
+    default:
+        return false;
+    }
+}
+
+/* Park the CPU before looping back to @dest if this is an idle loop */
+static void gen_idle(DisasContext *ctx, target_ulong dest)
+{
+    /* Let a debugger step through it */
+    if (ctx->base.singlestep_enabled) {
+        return;
+    }
+    if (is_idle_loop(ctx, dest)) {
+        tcg_gen_movi_tl(cpu_pc, dest & PC_MASK);
+        gen_helper_idle(cpu_env, tcg_constant_i32(ctx->cycles));
+    }
+}
+
+/*
+ * The TB may go on to @dest, a forward jump or branch target, rather than
+ * end: the TB only grows up to the end of its first page, so the code in
+ * between stays within the range of the TB.
+ */
+static bool can_follow(DisasContext *ctx, target_ulong dest)
+{
+    target_ulong page_first = ctx->base.pc_first & TARGET_PAGE_MASK;
+
+    return !ctx->base.singlestep_enabled
+        && ctx->base.num_insns < ctx->base.max_insns
+        && dest >= ctx->base.pc_next
+        && dest < page_first + TARGET_PAGE_SIZE;
+}
+
+/*
+ * Branch when @cond holds between @val and @cmp. Forward branches within
+ * reach are side exits of the TB which join the fall through path at their
+ * destination, skipping over if blocks without leaving the TB.
+ */
+static void gen_branch(DisasContext *ctx, TCGCond cond, TCGv val,
+                       target_ulong cmp)
+{
+    TCGLabel *taken = gen_new_label();
+    target_ulong dest = branch_dest(ctx);
+
+    if (ctx->nb_joins < MAX_JOINS && can_follow(ctx, dest)) {
+        TCGLabel *fall = gen_new_label();
+        int extra = ((ctx->base.pc_next ^ dest) & 0xff00) ? 2 : 1;
+
+        tcg_gen_brcondi_tl(tcg_invert_cond(cond), val, cmp, fall);
+        tcg_gen_addi_i64(cpu_cycles, cpu_cycles, ctx->cycles + extra);
+        tcg_gen_br(taken);
+        gen_set_label(fall);
+
+        ctx->joins[ctx->nb_joins].dest = dest;
+        ctx->joins[ctx->nb_joins].label = taken;
+        ctx->nb_joins++;
+        return;
+    }
+
+    tcg_gen_brcondi_tl(cond, val, cmp, taken);
+
+    gen_goto_tb(ctx, 0, ctx->base.pc_next);
+    gen_set_label(taken);
+    /* One more cycle when taken, two when the destination is in another page */
+    ctx->cycles += ((ctx->base.pc_next ^ dest) & 0xff00) ? 2 : 1;
+    gen_idle(ctx, dest);
+    gen_goto_tb(ctx, 1, dest);
+}
+
+/* Push the status register as PHP and BRK do, with B set */
+static void gen_push_sr(DisasContext *ctx)
+{
+    TCGv tmp = tcg_temp_new();
+
+    gen_compute_sr(tmp);
+    tcg_gen_ori_tl(tmp, tmp, 1 << SR_B);
+    gen_push(ctx, tmp);
+
+    tcg_temp_free(tmp);
+}
+
+/* B and bit 5 are not actual flip-flops, they are ignored when pulled */
+static void gen_pull_sr(DisasContext *ctx)
+{
+    TCGv tmp = tcg_temp_new();
+
+    gen_pull(ctx, tmp);
+    gen_split_sr(tmp);
+
+    tcg_temp_free(tmp);
+}
+
+static void gen_jsr(DisasContext *ctx)
+{
+    /* The address pushed is the one of the last byte of the JSR */
+    target_ulong ret = (ctx->base.pc_next - 1) & PC_MASK;
+
+    gen_pushi(ctx, ret >> 8);
+    gen_pushi(ctx, ret & 0xff);
+    gen_goto_tb(ctx, 0, ctx->operand);
+}
+
+static void gen_rts(DisasContext *ctx)
+{
+    TCGv tmp = tcg_temp_new();
+
+    gen_pull(ctx, cpu_pc);
+    gen_pull(ctx, tmp);
+    tcg_gen_deposit_tl(cpu_pc, cpu_pc, tmp, 8, 8);
+    tcg_gen_addi_tl(cpu_pc, cpu_pc, 1);
+    tcg_gen_andi_tl(cpu_pc, cpu_pc, PC_MASK);
+    ctx->base.is_jmp = DISAS_LOOKUP;
+
+    tcg_temp_free(tmp);
+}
+
+static void gen_rti(DisasContext *ctx)
+{
+    TCGv tmp = tcg_temp_new();
+
+    gen_pull_sr(ctx);
+    gen_pull(ctx, cpu_pc);
+    gen_pull(ctx, tmp);
+    tcg_gen_deposit_tl(cpu_pc, cpu_pc, tmp, 8, 8);
+    /* I may have been cleared, give pending interrupts a chance */
+    ctx->base.is_jmp = DISAS_EXIT;
+
+    tcg_temp_free(tmp);
+}
+
+static void gen_brk(DisasContext *ctx)
+{
+    /* BRK is followed by a padding byte which is skipped on return */
+    target_ulong ret = (ctx->base.pc_next + 1) & PC_MASK;
+    TCGv vector = tcg_const_tl(VECTOR_IRQ);
+
+    gen_pushi(ctx, ret >> 8);
+    gen_pushi(ctx, ret & 0xff);
+    gen_push_sr(ctx);
+    tcg_gen_ori_tl(cpu_sr, cpu_sr, 1 << SR_I);
+    if (has_feature(ctx, MCS6500_FEATURE_CMOS)) {
+        tcg_gen_andi_tl(cpu_sr, cpu_sr, ~(1 << SR_D) & 0xff);
+    }
+    gen_ld_word(ctx, cpu_pc, vector, PC_MASK, false);
+    ctx->base.is_jmp = DISAS_LOOKUP;
+
+    tcg_temp_free(vector);
+}
+
+/* BBR and BBS: branch on a bit of a zero page location */
+static void gen_bit_branch(DisasContext *ctx, bool set)
+{
+    TCGv val = tcg_temp_new();
+
+    tcg_gen_movi_tl(val, ctx->operand & 0xff);
+    gen_ld8(ctx, val, val, true);
+    tcg_gen_andi_tl(val, val, 1 << ((ctx->opcode >> 4) & 7));
+    gen_branch(ctx, set ? TCG_COND_NE : TCG_COND_EQ, val, 0);
+
+    tcg_temp_free(val);
+}
+
+/* WAI and STP, the CPU is halted after the instruction */
+static void gen_halt(DisasContext *ctx, void (*helper)(TCGv_env))
+{
+    gen_update_cycles(ctx);
+    tcg_gen_movi_tl(cpu_pc, ctx->base.pc_next & PC_MASK);
+    helper(cpu_env);
+    ctx->base.is_jmp = DISAS_NORETURN;
+}
+
+static void gen_illegal(DisasContext *ctx)
+{
+    gen_update_cycles(ctx);
+    tcg_gen_movi_tl(cpu_pc, ctx->pc);
+    gen_helper_illegal(cpu_env, tcg_constant_i32(ctx->opcode));
+    ctx->base.is_jmp = DISAS_NORETURN;
+}
+
+static void translate(DisasContext *ctx)
+{
+    const MCS6500Opcode *op = &ctx->opcodes[ctx->opcode];
+    TCGv val = NULL;
+
+    switch (op->insn) {
+    /* Load, store and transfer */
+    case INSN_LDA:
+        val = gen_load_operand(ctx, op->mode);
+        gen_transfer(cpu_acc, val);
+        break;
+    case INSN_LDX:
+        val = gen_load_operand(ctx, op->mode);
+        gen_transfer(cpu_x, val);
+        break;
+    case INSN_LDY:
+        val = gen_load_operand(ctx, op->mode);
+        gen_transfer(cpu_y, val);
+        break;
+    case INSN_STA:
+        gen_store_operand(ctx, op->mode, cpu_acc);
+        break;
+    case INSN_STX:
+        gen_store_operand(ctx, op->mode, cpu_x);
+        break;
+    case INSN_STY:
+        gen_store_operand(ctx, op->mode, cpu_y);
+        break;
+    case INSN_TAX:
+        gen_transfer(cpu_x, cpu_acc);
+        break;
+    case INSN_TAY:
+        gen_transfer(cpu_y, cpu_acc);
+        break;
+    case INSN_TXA:
+        gen_transfer(cpu_acc, cpu_x);
+        break;
+    case INSN_TYA:
+        gen_transfer(cpu_acc, cpu_y);
+        break;
+    case INSN_TSX:
+        gen_transfer(cpu_x, cpu_sp);
+        break;
+    case INSN_TXS:
+        tcg_gen_mov_tl(cpu_sp, cpu_x);
+        break;
+
+    /* Stack */
+    case INSN_PHA:
+        gen_push(ctx, cpu_acc);
+        break;
+    case INSN_PLA:
+        gen_pull(ctx, cpu_acc);
+        gen_update_nz(cpu_acc);
+        break;
+    case INSN_PHP:
+        gen_push_sr(ctx);
+        break;
+    case INSN_PLP:
+        gen_pull_sr(ctx);
+        /* I may have been cleared, give pending interrupts a chance */
+        ctx->base.is_jmp = DISAS_UPDATE;
+        break;
+
+    /* Arithmetic and logic */
+    case INSN_ADC:
+        val = gen_load_operand(ctx, op->mode);
+        gen_adc_insn(ctx, val);
+        break;
+    case INSN_SBC:
+        val = gen_load_operand(ctx, op->mode);
+        gen_sbc_insn(ctx, val);
+        break;
+    case INSN_AND:
+        val = gen_load_operand(ctx, op->mode);
+        tcg_gen_and_tl(cpu_acc, cpu_acc, val);
+        gen_update_nz(cpu_acc);
+        break;
+    case INSN_ORA:
+        val = gen_load_operand(ctx, op->mode);
+        tcg_gen_or_tl(cpu_acc, cpu_acc, val);
+        gen_update_nz(cpu_acc);
+        break;
+    case INSN_EOR:
+        val = gen_load_operand(ctx, op->mode);
+        tcg_gen_xor_tl(cpu_acc, cpu_acc, val);
+        gen_update_nz(cpu_acc);
+        break;
+    case INSN_CMP:
+        val = gen_load_operand(ctx, op->mode);
+        gen_cmp(cpu_acc, val);
+        break;
+    case INSN_CPX:
+        val = gen_load_operand(ctx, op->mode);
+        gen_cmp(cpu_x, val);
+        break;
+    case INSN_CPY:
+        val = gen_load_operand(ctx, op->mode);
+        gen_cmp(cpu_y, val);
+        break;
+    case INSN_BIT:
+        val = gen_load_operand(ctx, op->mode);
+        if (op->mode == AM_IMM) {
+            /* 65C02 BIT #, which only sets Z */
+            tcg_gen_and_tl(cpu_cc_z, cpu_acc, val);
+        } else {
+            gen_bit(val);
+        }
+        break;
+
+    /* Increments, decrements, shifts and rotations */
+    case INSN_INC:
+        gen_rmw(ctx, op->mode, gen_inc, NULL);
+        break;
+    case INSN_DEC:
+        gen_rmw(ctx, op->mode, gen_dec, NULL);
+        break;
+    case INSN_INX:
+        gen_inc(cpu_x);
+        break;
+    case INSN_INY:
+        gen_inc(cpu_y);
+        break;
+    case INSN_DEX:
+        gen_dec(cpu_x);
+        break;
+    case INSN_DEY:
+        gen_dec(cpu_y);
+        break;
+    case INSN_ASL:
+        gen_shift(ctx, op->mode, gen_asl);
+        break;
+    case INSN_LSR:
+        gen_shift(ctx, op->mode, gen_lsr);
+        break;
+    case INSN_ROL:
+        gen_shift(ctx, op->mode, gen_rol);
+        break;
+    case INSN_ROR:
+        gen_shift(ctx, op->mode, gen_ror);
+        break;
+
+    /* Jumps and calls */
+    case INSN_JMP:
+        if (op->mode == AM_ABS) {
+            gen_idle(ctx, ctx->operand);
+            if (can_follow(ctx, ctx->operand)) {
+                ctx->base.pc_next = ctx->operand;
+            } else {
+                gen_goto_tb(ctx, 0, ctx->operand);
+            }
+        } else {
+            val = gen_ea(ctx, op->mode, false);
+            tcg_gen_mov_tl(cpu_pc, val);
+            ctx->base.is_jmp = DISAS_LOOKUP;
+        }
+        break;
+    case INSN_JSR:
+        gen_jsr(ctx);
+        break;
+    case INSN_RTS:
+        gen_rts(ctx);
+        break;
+    case INSN_RTI:
+        gen_rti(ctx);
+        break;
+    case INSN_BRK:
+        gen_brk(ctx);
+        break;
+
+    /* Branches */
+    case INSN_BPL:
+        gen_branch(ctx, TCG_COND_LTU, cpu_cc_n, 0x80);
+        break;
+    case INSN_BMI:
+        gen_branch(ctx, TCG_COND_GEU, cpu_cc_n, 0x80);
+        break;
+    case INSN_BVC:
+    case INSN_BVS:
+        val = tcg_temp_new();
+        tcg_gen_andi_tl(val, cpu_cc_v, 0x80);
+        gen_branch(ctx, op->insn == INSN_BVS ? TCG_COND_NE : TCG_COND_EQ,
+                   val, 0);
+        break;
+    case INSN_BCC:
+        gen_branch(ctx, TCG_COND_EQ, cpu_cc_c, 0);
+        break;
+    case INSN_BCS:
+        gen_branch(ctx, TCG_COND_NE, cpu_cc_c, 0);
+        break;
+    case INSN_BNE:
+        gen_branch(ctx, TCG_COND_NE, cpu_cc_z, 0);
+        break;
+    case INSN_BEQ:
+        gen_branch(ctx, TCG_COND_EQ, cpu_cc_z, 0);
+        break;
+
+    /* Status register */
+    case INSN_CLC:
+        tcg_gen_movi_tl(cpu_cc_c, 0);
+        break;
+    case INSN_SEC:
+        tcg_gen_movi_tl(cpu_cc_c, 1);
+        break;
+    case INSN_CLI:
+        tcg_gen_andi_tl(cpu_sr, cpu_sr, ~(1 << SR_I) & 0xff);
+        ctx->base.is_jmp = DISAS_UPDATE;
+        break;
+    case INSN_SEI:
+        tcg_gen_ori_tl(cpu_sr, cpu_sr, 1 << SR_I);
+        break;
+    case INSN_CLV:
+        tcg_gen_movi_tl(cpu_cc_v, 0);
+        break;
+    case INSN_CLD:
+        tcg_gen_andi_tl(cpu_sr, cpu_sr, ~(1 << SR_D) & 0xff);
+        /* TBs are translated for a given D */
+        ctx->base.is_jmp = DISAS_UPDATE;
+        break;
+    case INSN_SED:
+        tcg_gen_ori_tl(cpu_sr, cpu_sr, 1 << SR_D);
+        ctx->base.is_jmp = DISAS_UPDATE;
+        break;
+
+    /* 65C02 */
+    case INSN_BRA:
+        /* One more cycle, two when the destination is in another page */
+        ctx->cycles += ((ctx->base.pc_next ^ branch_dest(ctx)) & 0xff00) ?
+            2 : 1;
+        gen_idle(ctx, branch_dest(ctx));
+        if (can_follow(ctx, branch_dest(ctx))) {
+            ctx->base.pc_next = branch_dest(ctx);
+        } else {
+            gen_goto_tb(ctx, 0, branch_dest(ctx));
+        }
+        break;
+    case INSN_PHX:
+        gen_push(ctx, cpu_x);
+        break;
+    case INSN_PHY:
+        gen_push(ctx, cpu_y);
+        break;
+    case INSN_PLX:
+        gen_pull(ctx, cpu_x);
+        gen_update_nz(cpu_x);
+        break;
+    case INSN_PLY:
+        gen_pull(ctx, cpu_y);
+        gen_update_nz(cpu_y);
+        break;
+    case INSN_STZ:
+        gen_store_operand(ctx, op->mode, tcg_constant_tl(0));
+        break;
+    case INSN_TSB:
+        gen_rmw(ctx, op->mode, gen_tsb, NULL);
+        break;
+    case INSN_TRB:
+        gen_rmw(ctx, op->mode, gen_trb, NULL);
+        break;
+
+    /* Rockwell and WDC */
+    case INSN_RMB:
+        gen_bit_rmw(ctx, false);
+        break;
+    case INSN_SMB:
+        gen_bit_rmw(ctx, true);
+        break;
+    case INSN_BBR:
+        gen_bit_branch(ctx, false);
+        break;
+    case INSN_BBS:
+        gen_bit_branch(ctx, true);
+        break;
+    case INSN_WAI:
+        gen_halt(ctx, gen_helper_wai);
+        break;
+    case INSN_STP:
+        gen_halt(ctx, gen_helper_stp);
+        break;
+
+    /* NMOS undocumented */
+    case INSN_SLO:
+        gen_rmw(ctx, op->mode, gen_slo, NULL);
+        break;
+    case INSN_RLA:
+        gen_rmw(ctx, op->mode, gen_rla, NULL);
+        break;
+    case INSN_SRE:
+        gen_rmw(ctx, op->mode, gen_sre, NULL);
+        break;
+    case INSN_DCP:
+        gen_rmw(ctx, op->mode, gen_dcp, NULL);
+        break;
+    case INSN_RRA:
+        val = tcg_temp_new();
+        gen_rmw(ctx, op->mode, gen_ror, val);
+        gen_adc_insn(ctx, val);
+        break;
+    case INSN_ISC:
+        val = tcg_temp_new();
+        gen_rmw(ctx, op->mode, gen_inc, val);
+        gen_sbc_insn(ctx, val);
+        break;
+    case INSN_SAX:
+        val = tcg_temp_new();
+        tcg_gen_and_tl(val, cpu_acc, cpu_x);
+        gen_store_operand(ctx, op->mode, val);
+        break;
+    case INSN_LAX:
+        val = gen_load_operand(ctx, op->mode);
+        gen_transfer(cpu_acc, val);
+        tcg_gen_mov_tl(cpu_x, val);
+        break;
+    case INSN_ANC:
+        val = gen_load_operand(ctx, op->mode);
+        gen_anc(val);
+        break;
+    case INSN_ALR:
+        val = gen_load_operand(ctx, op->mode);
+        tcg_gen_and_tl(cpu_acc, cpu_acc, val);
+        gen_lsr(cpu_acc);
+        break;
+    case INSN_ARR:
+        val = gen_load_operand(ctx, op->mode);
+        gen_arr(val);
+        break;
+    case INSN_SBX:
+        val = gen_load_operand(ctx, op->mode);
+        gen_sbx(val);
+        break;
+
+    case INSN_NOP:
+        /* Undocumented NOPs still read their operand */
+        if (op->mode != AM_IMP) {
+            val = gen_load_operand(ctx, op->mode);
+        }
+        break;
+    case INSN_ILL:
+        gen_illegal(ctx);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    if (val) {
+        tcg_temp_free(val);
+    }
+}
+
 static void mcs6500_tr_init_disas_context(DisasContextBase *dcbase, CPUState *cs)
 {
+    DisasContext *ctx = container_of(dcbase, DisasContext, base);
+
+    ctx->env = cs->env_ptr;
+    ctx->cycles = 0;
+    /*
+     * mcs6500_cpu_tlb_fill() turns direct accesses off when code is fetched
+     * from pages 0 or 1, this TB may have been looked up before that.
+     */
+    ctx->zp_ram = (ctx->base.tb->flags & TB_FLAGS_ZP_RAM)
+        && ctx->base.pc_first >= ZP_RAM_SIZE;
+    ctx->decimal = ctx->base.tb->flags & TB_FLAGS_DECIMAL;
+    ctx->idle_load = false;
+    ctx->nb_joins = 0;
+    ctx->profile = NULL;
+    ctx->features = ctx->base.tb->flags >> TB_FLAGS_FEATURES_SHIFT;
+    ctx->opcodes = opcode_tables[ctx->features];
 }
 
 static void mcs6500_tr_tb_start(DisasContextBase *db, CPUState *cpu)
 {
+    DisasContext *ctx = container_of(db, DisasContext, base);
+
+    if (ctx->env->tb_profile) {
+        TCGv_ptr count;
+        TCGv_i64 tmp = tcg_temp_new_i64();
+
+        ctx->profile = mcs6500_tb_profile_get(ctx->env, ctx->base.pc_first,
+                                              ctx->base.tb->flags);
+        count = tcg_const_ptr(ctx->profile);
+        tcg_gen_ld_i64(tmp, count, 0);
+        tcg_gen_addi_i64(tmp, tmp, 1);
+        tcg_gen_st_i64(tmp, count, 0);
+
+        tcg_temp_free_ptr(count);
+        tcg_temp_free_i64(tmp);
+    }
+
+    /* Batch runs only, the cycle count is exact on TB entry */
+    if (ctx->base.tb->flags & TB_FLAGS_CYCLE_LIMIT) {
+        TCGLabel *run = gen_new_label();
+        TCGv_i64 limit = tcg_temp_new_i64();
+
+        tcg_gen_ld_i64(limit, cpu_env, offsetof(CPUMCS6500State, cycle_limit));
+        tcg_gen_brcond_i64(TCG_COND_LTU, cpu_cycles, limit, run);
+        tcg_gen_movi_tl(cpu_pc, ctx->base.pc_first & PC_MASK);
+        gen_helper_batch_stop(cpu_env);
+        gen_set_label(run);
+
+        tcg_temp_free_i64(limit);
+    }
 }
 
 static void mcs6500_tr_insn_start(DisasContextBase *dcbase, CPUState *cpu)
 {
+    DisasContext *ctx = container_of(dcbase, DisasContext, base);
+    bool joined = false;
+
+    /* Both paths bring cpu_cycles up to date before joining */
+    for (int i = 0; i < ctx->nb_joins; ++i) {
+        if (ctx->joins[i].label && ctx->joins[i].dest == dcbase->pc_next) {
+            if (!joined) {
+                gen_update_cycles(ctx);
+                ctx->cycles = 0;
+                joined = true;
+            }
+            gen_set_label(ctx->joins[i].label);
+            ctx->joins[i].label = NULL;
+        }
+    }
+
+    tcg_gen_insn_start(dcbase->pc_next & PC_MASK, ctx->cycles);
+}
+
+/*
+ * The main loop checks breakpoints when it looks a TB up and only translates
+ * one instruction per TB on the page of a breakpoint, the TBs translated
+ * before are flushed, see mcs6500_cpu_gdb_adjust_breakpoint(). A TB coming
+ * from the page before could still run into it, end TBs right before
+ * breakpoints.
+ */
+static bool breakpoint_at(CPUState *cpu, target_ulong pc)
+{
+    CPUBreakpoint *bp;
+
+    QTAILQ_FOREACH(bp, &cpu->breakpoints, entry) {
+        if (bp->pc == pc) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Plain loads from a fixed address, BIT included */
+static bool is_idle_load(const MCS6500Opcode *op)
+{
+    switch (op->insn) {
+    case INSN_LDA:
+    case INSN_LDX:
+    case INSN_LDY:
+    case INSN_BIT:
+        return op->mode == AM_ZP || op->mode == AM_ABS;
+    default:
+        return false;
+    }
 }
 
 static void mcs6500_tr_translate_insn(DisasContextBase *dcbase, CPUState *cpu)
 {
+    DisasContext *ctx = container_of(dcbase, DisasContext, base);
+    target_ulong page_first = ctx->base.pc_first & TARGET_PAGE_MASK;
+    int size;
+
+    ctx->pc = ctx->base.pc_next & PC_MASK;
+    ctx->opcode = translator_ldub(ctx->env, &ctx->base, ctx->pc);
+    size = operand_size[ctx->opcodes[ctx->opcode].mode];
+
+    ctx->operand = 0;
+    for (int i = 0; i < size; ++i) {
+        uint8_t byte = translator_ldub(ctx->env, &ctx->base,
+                                       (ctx->pc + 1 + i) & PC_MASK);
+        ctx->operand |= byte << (8 * i);
+    }
+    ctx->base.pc_next += 1 + size;
+
+    if (ctx->pc == ctx->env->trap_pc) {
+        gen_update_cycles(ctx);
+        tcg_gen_movi_tl(cpu_pc, ctx->pc);
+        gen_helper_batch_stop(cpu_env);
+        ctx->base.is_jmp = DISAS_NORETURN;
+        return;
+    }
+
+    if (ctx->env->itrace) {
+        gen_helper_itrace(cpu_env,
+                          tcg_constant_i32(ctx->pc | ctx->opcode << 16
+                                           | (1 + size) << 24),
+                          tcg_constant_i32(ctx->cycles));
+    }
+
+    ctx->cycles += ctx->opcodes[ctx->opcode].cycles;
+
+    if (ctx->base.num_insns == 1) {
+        ctx->idle_load = is_idle_load(&ctx->opcodes[ctx->opcode]);
+    }
+
+    translate(ctx);
+
+    /* A TB may span two pages at most, stop before reaching a third one */
+    if (ctx->base.is_jmp == DISAS_NEXT
+            && (ctx->base.pc_next - page_first >= TARGET_PAGE_SIZE
+                || breakpoint_at(cpu, ctx->base.pc_next & PC_MASK))) {
+        ctx->base.is_jmp = DISAS_TOO_MANY;
+    }
 }
 
 static void mcs6500_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
 {
+    DisasContext *ctx = container_of(dcbase, DisasContext, base);
+
+    if (ctx->profile) {
+        mcs6500_tb_profile_set_size(ctx->profile,
+                                    ctx->base.pc_next - ctx->base.pc_first,
+                                    ctx->base.num_insns);
+    }
+
+    switch (ctx->base.is_jmp) {
+    case DISAS_NORETURN:
+        break;
+    case DISAS_NEXT:
+    case DISAS_TOO_MANY:
+        gen_goto_tb(ctx, 0, ctx->base.pc_next);
+        break;
+    case DISAS_LOOKUP:
+        gen_update_cycles(ctx);
+        tcg_gen_lookup_and_goto_ptr();
+        break;
+    case DISAS_UPDATE:
+        tcg_gen_movi_tl(cpu_pc, ctx->base.pc_next & PC_MASK);
+        /* fall through */
+    case DISAS_EXIT:
+        gen_update_cycles(ctx);
+        tcg_gen_exit_tb(NULL, 0);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    /* Branches whose destination was skipped or not reached */
+    for (int i = 0; i < ctx->nb_joins; ++i) {
+        if (ctx->joins[i].label) {
+            gen_set_label(ctx->joins[i].label);
+            tcg_gen_movi_tl(cpu_pc, ctx->joins[i].dest & PC_MASK);
+            tcg_gen_lookup_and_goto_ptr();
+        }
+    }
 }
 
 static void mcs6500_tr_disas_log(const DisasContextBase *dcbase, CPUState *cpu)
 {
+    qemu_log("IN: %s\n", lookup_symbol(dcbase->pc_first));
+    log_target_disas(cpu, dcbase->pc_first, dcbase->tb->size);
 }
 
 static const TranslatorOps mcs6500_tr_ops = {
@@ -53,12 +2082,13 @@ void restore_state_to_opc(CPUMCS6500State *env, TranslationBlock *tb,
                           target_ulong *data)
 {
     env->pc = (uint16_t) (data[0] & PC_MASK);
-}
-
-void mcs6500_cpu_tcg_init(void)
-{
+    /* The TB is left before reaching its gen_update_cycles() */
+    env->cycles += data[1];
 }
 
 void mcs6500_cpu_synchronize_from_tb(CPUState *cs, const TranslationBlock *tb)
 {
+    MCS6500CPU *cpu = MCS6500_CPU(cs);
+
+    cpu->env.pc = tb->pc & PC_MASK;
 }
@@ -0,0 +1,331 @@
+#
+# Batch runs of small 6502 programs on the mcs6500 minimal machine
+#
+# Copyright (c) 2020 Alexandre Guyon
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+import hashlib
+import os
+import re
+import time
+
+from avocado.utils.wait import wait_for
+from avocado_qemu import QemuSystemTest
+
+# The reset sequence takes as many cycles as an interrupt
+RESET_CYCLES = 7
+
+
+def image(code, origin=0x0400):
+    """A flat 64 KiB image with @code at @origin, where reset jumps"""
+    ram = bytearray(0x10000)
+    ram[origin:origin + len(code)] = code
+    ram[0xfffc:0xfffe] = origin.to_bytes(2, 'little')
+    return ram
+
+
+class MCS6500Minimal(QemuSystemTest):
+    """
+    Each program runs up to its trap-pc, the state printed by the machine
+    is then compared with the one expected, the RAM hash included.
+
+    :avocado: tags=arch:mcs6500
+    :avocado: tags=machine:minimal
+    """
+    timeout = 10
+
+    def launch_batch(self, ram, trap_pc, *args):
+        path = os.path.join(self.workdir, 'image.bin')
+        with open(path, 'wb') as f:
+            f.write(ram)
+
+        # Stopped until QMP is up, the run is over in a few microseconds
+        self.vm.add_args('-nodefaults', '-S', '-bios', path,
+                         '-global', '6500.trap-pc=0x%04x' % trap_pc, *args)
+        self.vm.launch()
+
+    def run_batch(self, ram, trap_pc, *args):
+        self.launch_batch(ram, trap_pc, *args)
+        self.vm.command('cont')
+        self.vm.wait()
+        return self.vm.get_log()
+
+    def assert_batch(self, log, ram, pc, a, x, y, sp, sr, cycles):
+        line = ('PC=%04x A=%02x X=%02x Y=%02x SP=%02x SR=%02x CYC=%d '
+                'RAM=%s FB=-' % (pc, a, x, y, sp, sr, cycles,
+                                 hashlib.sha256(ram).hexdigest()))
+        self.assertIn(line, log)
+
+    STORE_LOOP = bytes([
+        0xa2, 0x00,         # 0400 LDX #$00
+        0x8a,               # 0402 TXA
+        0x9d, 0x00, 0x02,   # 0403 STA $0200,X
+        0xe8,               # 0406 INX
+        0xd0, 0xf9,         # 0407 BNE $0402
+    ])
+    # 9 cycles per iteration, 3 for the branch taken, 2 for the last one
+    STORE_LOOP_CYCLES = RESET_CYCLES + 2 + 256 * 9 + 255 * 3 + 2
+
+    def assert_store_loop(self, log, ram):
+        ram[0x0200:0x0300] = bytes(range(256))
+        self.assert_batch(log, ram, pc=0x0409, a=0xff, x=0, y=0, sp=0xfd,
+                          sr=0x26, cycles=self.STORE_LOOP_CYCLES)
+
+    def test_store_loop(self):
+        ram = image(self.STORE_LOOP)
+        log = self.run_batch(ram, 0x0409)
+        self.assert_store_loop(log, ram)
+
+    def test_snapshot_rewind(self):
+        """
+        Run, rewind to the start and run again: the second run must end in
+        the same state, with the cycle count of the snapshot restored
+        """
+        ram = image(self.STORE_LOOP)
+        self.launch_batch(ram, 0x0409, '-no-shutdown')
+        self.vm.command('x-mcs6500-snapshot-save', name='start')
+        for _ in range(2):
+            self.vm.command('cont')
+            self.vm.event_wait('SHUTDOWN')
+            self.vm.command('x-mcs6500-snapshot-load', name='start')
+        self.vm.shutdown()
+        log = self.vm.get_log()
+
+        lines = [l for l in log.splitlines() if l.startswith('PC=')]
+        self.assertEqual(len(lines), 2)
+        self.assertEqual(lines[0], lines[1])
+        self.assert_store_loop(log, ram)
+
+    DECIMAL = bytes([
+        0xf8,               # 0400 SED
+        0x18,               # 0401 CLC
+        0xa9, 0x19,         # 0402 LDA #$19
+        0x69, 0x28,         # 0404 ADC #$28
+        0x85, 0x10,         # 0406 STA $10
+        0x38,               # 0408 SEC
+        0xa9, 0x50,         # 0409 LDA #$50
+        0xe9, 0x01,         # 040B SBC #$01
+        0x85, 0x11,         # 040D STA $11
+        0xa9, 0x99,         # 040F LDA #$99
+        0x69, 0x01,         # 0411 ADC #$01
+        0x85, 0x12,         # 0413 STA $12
+        0xd8,               # 0415 CLD
+        0xb8,               # 0416 CLV
+        0xa2, 0x01,         # 0417 LDX #$01
+    ])
+    DECIMAL_CYCLES = RESET_CYCLES + 12 * 2 + 3 * 3
+
+    def test_decimal(self):
+        """
+        :avocado: tags=cpu:6502
+        """
+        ram = image(self.DECIMAL)
+        log = self.run_batch(ram, 0x0419)
+
+        ram[0x10:0x13] = bytes([0x47, 0x49, 0x01])
+        self.assert_batch(log, ram, pc=0x0419, a=0x01, x=0x01, y=0, sp=0xfd,
+                          sr=0x25, cycles=self.DECIMAL_CYCLES)
+
+    def test_decimal_2a03(self):
+        """
+        The 2A03 has no decimal mode, D is set but ignored
+
+        :avocado: tags=cpu:2a03
+        """
+        ram = image(self.DECIMAL)
+        log = self.run_batch(ram, 0x0419)
+
+        ram[0x10:0x13] = bytes([0x41, 0x4f, 0x9b])
+        self.assert_batch(log, ram, pc=0x0419, a=0x9b, x=0x01, y=0, sp=0xfd,
+                          sr=0x24, cycles=self.DECIMAL_CYCLES)
+
+    def test_cmos(self):
+        """
+        65C02 opcodes and addressing modes, with JMP ($01FF) which reads the
+        high byte of the destination from $0200 rather than from $0100
+
+        :avocado: tags=cpu:65c02
+        """
+        ram = image(bytes([
+            0xa9, 0x00,         # 0400 LDA #$00
+            0x85, 0x20,         # 0402 STA $20
+            0xa9, 0x03,         # 0404 LDA #$03
+            0x85, 0x21,         # 0406 STA $21
+            0xa9, 0x41,         # 0408 LDA #$41
+            0x1a,               # 040A INC A
+            0x92, 0x20,         # 040B STA ($20)
+            0x9c, 0x01, 0x03,   # 040D STZ $0301
+            0xa2, 0x07,         # 0410 LDX #$07
+            0xda,               # 0412 PHX
+            0x7a,               # 0413 PLY
+            0x8c, 0x02, 0x03,   # 0414 STY $0302
+            0xa9, 0x30,         # 0417 LDA #$30
+            0x8d, 0xff, 0x01,   # 0419 STA $01FF
+            0xa9, 0x04,         # 041C LDA #$04
+            0x8d, 0x00, 0x02,   # 041E STA $0200
+            0x6c, 0xff, 0x01,   # 0421 JMP ($01FF)
+        ]))
+        ram[0x0430:0x0434] = bytes([
+            0x80, 0x02,         # 0430 BRA $0434
+            0x00, 0x00,         # 0432 BRK
+        ])
+        ram[0x0301] = 0xff
+        log = self.run_batch(ram, 0x0434)
+
+        cycles = (RESET_CYCLES + 2 + 3 + 2 + 3 + 2 + 2 + 5 + 4 + 2 + 3 + 4 + 4
+                  + 2 + 4 + 2 + 4 + 6 + 3)
+        ram[0x20:0x22] = bytes([0x00, 0x03])
+        ram[0x0300:0x0303] = bytes([0x42, 0x00, 0x07])
+        ram[0x01fd] = 0x07
+        ram[0x01ff] = 0x30
+        ram[0x0200] = 0x04
+        self.assert_batch(log, ram, pc=0x0434, a=0x04, x=0x07, y=0x07,
+                          sp=0xfd, sr=0x24, cycles=cycles)
+
+    COUNT_LOOP = bytes([
+        0xe6, 0x10,         # 0400 INC $10
+        0xd0, 0xfc,         # 0402 BNE $0400
+        0xe6, 0x11,         # 0404 INC $11
+        0xd0, 0xf8,         # 0406 BNE $0400
+        0xe6, 0x12,         # 0408 INC $12
+        0xd0, 0xf4,         # 040A BNE $0400
+        0x4c, 0x0c, 0x04,   # 040C JMP $040C
+    ])
+
+    def test_migrate_to_file(self):
+        """
+        Start-up from a migrated state, as README.mcs6500 documents it:
+        migrate in the middle of a 24 bits counting loop to a file, then
+        run the loop to its end from that file. Running the reset sequence
+        again would leave more cycles on the count.
+        """
+        ram = image(self.COUNT_LOOP)
+        path = os.path.join(self.workdir, 'image.bin')
+        state = os.path.join(self.workdir, 'minimal.state')
+        with open(path, 'wb') as f:
+            f.write(ram)
+
+        source = self.get_vm('-nodefaults', '-S', '-bios', path,
+                             name='source')
+        source.launch()
+        for _ in range(100):
+            source.command('cont')
+            time.sleep(0.01)
+            source.command('stop')
+            regs = source.command('human-monitor-command',
+                                  command_line='info registers')
+            pc = int(re.search(r'PC=([0-9a-f]+)', regs).group(1), 16)
+            cycles = int(re.search(r'CYC=(\d+)', regs).group(1))
+            if cycles > RESET_CYCLES:
+                break
+        if pc == 0x040c:
+            self.cancel('The loop ended before it could be migrated')
+        source.command('human-monitor-command',
+                       command_line='migrate "exec:cat > %s"' % state)
+        wait_for(lambda: source.command('query-migrate')['status']
+                 == 'completed', timeout=30, step=0.1)
+        source.shutdown()
+
+        # Paused as the source was, until the state is loaded
+        dest = self.get_vm('-nodefaults', '-bios', path,
+                           '-global', '6500.trap-pc=0x040c',
+                           '-incoming', 'exec:cat %s' % state, name='dest')
+        dest.launch()
+        wait_for(lambda: dest.command('query-status')['status'] == 'paused',
+                 timeout=30, step=0.1)
+        dest.command('cont')
+        dest.wait()
+        log = dest.get_log()
+
+        # As many branches as increments, those which are not taken carry
+        inc = (1 << 24) + (1 << 16) + (1 << 8)
+        carry = (1 << 16) + (1 << 8) + 1
+        cycles = RESET_CYCLES + 5 * inc + 3 * (inc - carry) + 2 * carry
+        self.assert_batch(log, ram, pc=0x040c, a=0, x=0, y=0, sp=0xfd,
+                          sr=0x26, cycles=cycles)
+
+    def test_forward_branches(self):
+        """
+        A forward branch both taken and not taken within a TB, and a
+        forward JMP followed by the translator
+        """
+        ram = image(bytes([
+            0xa2, 0x03,         # 0400 LDX #$03
+            0xa0, 0x00,         # 0402 LDY #$00
+            0xe0, 0x02,         # 0404 CPX #$02
+            0xf0, 0x01,         # 0406 BEQ $0409
+            0xc8,               # 0408 INY
+            0xca,               # 0409 DEX
+            0xd0, 0xf8,         # 040A BNE $0404
+            0x4c, 0x10, 0x04,   # 040C JMP $0410
+            0x00,               # 040F BRK
+            0x94, 0x20,         # 0410 STY $20,X
+        ]))
+        log = self.run_batch(ram, 0x0412)
+
+        # The BEQ is taken on the second iteration only
+        cycles = RESET_CYCLES + 2 + 2 + 11 + 10 + 10 + 3 + 4
+        ram[0x20] = 0x02
+        self.assert_batch(log, ram, pc=0x0412, a=0, x=0, y=0x02, sp=0xfd,
+                          sr=0x26, cycles=cycles)
+
+
+def ines_image(code):
+    """An NROM iNES image with @code at $C000, where reset jumps"""
+    header = b'NES\x1a' + bytes([1, 1]) + bytes(10)
+    prg = bytearray(0x4000)
+    prg[0:len(code)] = code
+    prg[0x3ffa:0x4000] = (0xc000).to_bytes(2, 'little') * 3
+    return header + prg + bytes(0x2000)
+
+
+class MCS6500Nes(QemuSystemTest):
+    """
+    :avocado: tags=arch:mcs6500
+    :avocado: tags=machine:nes
+    """
+    timeout = 10
+
+    def test_idle_masked_irq(self):
+        """
+        An idle loop with I set stays parked while the APU frame IRQ, which
+        nothing acknowledges, is asserted: woken up by the IRQ it would run
+        again at once, as many times as the host can.
+        """
+        path = os.path.join(self.workdir, 'idle.nes')
+        with open(path, 'wb') as f:
+            f.write(ines_image(bytes([
+                0x78,               # C000 SEI
+                0xa5, 0x10,         # C001 LDA $10
+                0xf0, 0xfc,         # C003 BEQ $C001
+            ])))
+
+        self.vm.add_args('-nodefaults', '-S', '-bios', path,
+                         '-audiodev', 'none,id=snd',
+                         '-global', 'nes-apu.audiodev=snd',
+                         '-global', '6500.tb-profile=on')
+        self.vm.launch()
+        self.vm.command('cont')
+        time.sleep(1)
+        self.vm.command('stop')
+        profile = self.vm.command('x-query-mcs6500-tb-profile')
+        text = profile['human-readable-text']
+
+        # Device timers still wake the loop up, a few thousand times a second
+        count = sum(int(c) for c in
+                    re.findall(r'^c001 flags=\w+ count=(\d+)', text, re.M))
+        self.assertGreater(count, 0)
+        self.assertLess(count, 100000)